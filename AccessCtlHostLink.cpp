@@ -0,0 +1,303 @@
+/**
+ * @file 		AccessCtlHostLink.cpp
+ *
+ * @author 		Stephen Kairu (kairu@pheenek.com)
+ *
+ * @brief	    This file contains the implementations for the serial management link to the host service
+ *
+ * @version 	0.1
+ *
+ * @date 		2026-10-16
+ *
+ * ***************************************************************************
+ * @copyright Copyright (c) 2023, Stephen Kairu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the “Software”), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ***************************************************************************
+ *
+ */
+#include "AccessCtlHostLink.h"
+
+/**
+ * Enumeration defining the positions of the frame parser
+ */
+typedef enum HOST_LINK_RX : uint8_t
+{
+  RX_SYNC,    /*< Waiting for HOST_LINK_SYNC */
+  RX_TYPE,    /*< Expecting the frame type */
+  RX_LENGTH,  /*< Expecting the payload length */
+  RX_PAYLOAD, /*< Receiving the payload */
+  RX_SUM      /*< Expecting the checksum */
+} HostLinkRx_t;
+
+/**
+ * @brief	 Attaches the link to a serial port, already started
+ * 
+ * @param port 
+ * @return none
+ */
+void AccessCtlHostLink::begin(Stream *port)
+{
+    this->port = port;
+    rxState = RX_SYNC;
+}
+
+/**
+ * @brief	 Link loop, parses the frames received from the host
+ * 
+ * @param none
+ * @return none
+ */
+void AccessCtlHostLink::linkLoop(void)
+{
+    if (port == NULL) return;
+
+    while (port->available() > 0)
+    {
+        parseByte(port->read());
+    }
+}
+
+/**
+ * @brief	Checks whether the host was heard from recently enough to be asked
+ *          A lookup only costs a verification time when someone is there to answer it
+ * 
+ * @return bool 
+ */
+bool AccessCtlHostLink::online(void)
+{
+    return heard && ((millis() - lastHeardMillis) < HOST_LINK_ONLINE_MS);
+}
+
+/**
+ * @brief	 Sends a frame to the host
+ * 
+ * @param type 
+ * @param payload 
+ * @param length 
+ * @return none
+ */
+void AccessCtlHostLink::sendFrame(uint8_t type, const uint8_t *payload, uint8_t length)
+{
+    if (port == NULL) return;
+
+    uint8_t sum = type + length;
+
+    port->write(HOST_LINK_SYNC);
+    port->write(type);
+    port->write(length);
+    for (uint8_t i = 0; i < length; i++)
+    {
+        port->write(payload[i]);
+        sum += payload[i];
+    }
+    port->write(sum);
+}
+
+/**
+ * @brief	 Sends a chunk of the feature template to look up, as it is uploaded from the sensor
+ * 
+ * @param data 
+ * @param length 
+ * @return none
+ */
+void AccessCtlHostLink::sendFeatures(const uint8_t *data, uint16_t length)
+{
+    while (length > 0)
+    {
+        uint8_t chunk = (length > 0xFF) ? 0xFF : length;
+        sendFrame(HOST_MSG_FEATURES, data, chunk);
+        featureBytes += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+/**
+ * @brief	 Asks the host to match the features sent
+ * 
+ * @param none
+ * @return none
+ */
+void AccessCtlHostLink::requestLookup(void)
+{
+    uint8_t payload[2] = { (uint8_t)(featureBytes >> 8), (uint8_t)(featureBytes & 0xFF) };
+
+    sendFrame(HOST_MSG_LOOKUP, payload, sizeof(payload));
+    lookupState = HOST_LOOKUP_PENDING;
+    lookupMillis = millis();
+}
+
+/**
+ * @brief	Returns the state of the lookup, timing it out if the host took too long to answer or to send the
+ *          next template bytes. A finished lookup stays reported until the next request
+ * 
+ * @return HostLookup_t 
+ */
+HostLookup_t AccessCtlHostLink::lookup(void)
+{
+    if ((lookupState == HOST_LOOKUP_PENDING) && ((millis() - lookupMillis) >= HOST_LINK_LOOKUP_TIMEOUT_MS))
+    {
+        lookupState = HOST_LOOKUP_FAILED;
+    }
+    if ((lookupState == HOST_LOOKUP_MATCH) && pullPending && ((millis() - pullMillis) >= HOST_LINK_PULL_TIMEOUT_MS))
+    {
+        lookupState = HOST_LOOKUP_FAILED;
+    }
+
+    return lookupState;
+}
+
+/**
+ * @brief	 Asks the host for the next bytes of the matched template
+ *          The host only sends what was asked for, so the 64-byte serial receive buffer can't overflow
+ * 
+ * @param none
+ * @return none
+ */
+void AccessCtlHostLink::requestData(void)
+{
+    uint16_t remaining = matchLength - templateBytes;
+    uint8_t request = (remaining > HOST_LINK_MAX_PAYLOAD) ? HOST_LINK_MAX_PAYLOAD : remaining;
+
+    sendFrame(HOST_MSG_PULL, &request, 1);
+    pullPending = true;
+    pullMillis = millis();
+}
+
+/**
+ * @brief	Takes the next bytes of the matched template, asking the host for more once they are used up
+ *          Only one answer is held at a time, so the template never has to fit in RAM
+ * 
+ * @param data 
+ * @param length 
+ * @return uint16_t -> bytes copied, 0 while the host hasn't sent them yet
+ * @return HOST_LINK_READ_FAILED -> The host stopped answering, the rest of the template won't come
+ */
+uint16_t AccessCtlHostLink::readTemplate(uint8_t *data, uint16_t length)
+{
+    if (lookup() != HOST_LOOKUP_MATCH) return HOST_LINK_READ_FAILED;
+
+    uint8_t available = chunkLength - chunkRead;
+    if (length > available) length = available;
+
+    memcpy(data, chunk + chunkRead, length);
+    chunkRead += length;
+
+    if ((chunkRead == chunkLength) && !pullPending && (templateBytes < matchLength)) requestData();
+    return length;
+}
+
+/**
+ * @brief	 Parses one byte received from the host
+ *          A frame with a bad checksum or an oversized payload is dropped, and the parser hunts for the next sync
+ * 
+ * @param byte 
+ * @return none
+ */
+void AccessCtlHostLink::parseByte(uint8_t byte)
+{
+    switch (rxState)
+    {
+        case RX_SYNC:
+            if (byte == HOST_LINK_SYNC) rxState = RX_TYPE;
+            break;
+
+        case RX_TYPE:
+            rxType = byte;
+            rxSum = byte;
+            rxState = RX_LENGTH;
+            break;
+
+        case RX_LENGTH:
+            if (byte > HOST_LINK_MAX_PAYLOAD)
+            {
+                rxState = RX_SYNC;
+                break;
+            }
+            rxLength = byte;
+            rxCount = 0;
+            rxSum += byte;
+            rxState = (rxLength > 0) ? RX_PAYLOAD : RX_SUM;
+            break;
+
+        case RX_PAYLOAD:
+            rxPayload[rxCount++] = byte;
+            rxSum += byte;
+            if (rxCount == rxLength) rxState = RX_SUM;
+            break;
+
+        default:
+            rxState = RX_SYNC;
+            if (byte == rxSum) handleFrame();
+            break;
+    }
+}
+
+/**
+ * @brief	 Acts on a complete frame received from the host
+ *          Any valid frame counts as a sign of life
+ * 
+ * @param none
+ * @return none
+ */
+void AccessCtlHostLink::handleFrame(void)
+{
+    heard = true;
+    lastHeardMillis = millis();
+
+    switch (rxType)
+    {
+        case HOST_MSG_MATCH:
+            if ((lookupState != HOST_LOOKUP_PENDING) || (rxLength < 2)) break;
+            matchLength = ((uint16_t)rxPayload[0] << 8) | rxPayload[1];
+            if ((matchLength == 0) || (matchLength > HOST_LINK_TEMPLATE_MAX))
+            {
+                lookupState = HOST_LOOKUP_FAILED;
+                break;
+            }
+            // ask for the first bytes now, they arrive while the sensor is asked to take the template
+            templateBytes = 0;
+            chunkLength = 0;
+            chunkRead = 0;
+            lookupState = HOST_LOOKUP_MATCH;
+            requestData();
+            break;
+
+        case HOST_MSG_NO_MATCH:
+            if (lookupState != HOST_LOOKUP_PENDING) break;
+            lookupState = HOST_LOOKUP_NO_MATCH;
+            break;
+
+        case HOST_MSG_DATA:
+        {
+            if ((lookupState != HOST_LOOKUP_MATCH) || !pullPending) break;
+
+            uint16_t remaining = matchLength - templateBytes;
+            uint8_t received = (rxLength > remaining) ? remaining : rxLength;
+            memcpy(chunk, rxPayload, received);
+            chunkLength = received;
+            chunkRead = 0;
+            templateBytes += received;
+            pullPending = false;
+            break;
+        }
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,228 @@
+/**
+ * @file 		AccessCtlHostLink.h
+ *
+ * @author 		Stephen Kairu (kairu@pheenek.com)
+ *
+ * @brief	    This file contains the definitions for the serial management link to the host service
+ *            The host keeps the full template database, the controller asks it about fingerprints the sensor
+ *            library doesn't hold
+ *
+ * @version 	0.1
+ *
+ * @date 		2026-10-16
+ *
+ * ***************************************************************************
+ * @copyright Copyright (c) 2023, Stephen Kairu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the “Software”), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ***************************************************************************
+ *
+ */
+#ifndef ACCESS_CTL_HOST_LINK_H
+#define ACCESS_CTL_HOST_LINK_H
+
+#include "Arduino.h"
+
+#define HOST_LINK_SYNC 0x7E              /*< First byte of every frame */
+#define HOST_LINK_MAX_PAYLOAD 16         /*< Largest payload the controller accepts from the host */
+#define HOST_LINK_ONLINE_MS 10000        /*< The host counts as online this long after its last frame */
+#define HOST_LINK_LOOKUP_TIMEOUT_MS 2000 /*< Time the host has to answer a lookup */
+#define HOST_LINK_PULL_TIMEOUT_MS 200    /*< Time the host has to answer each template data request */
+#define HOST_LINK_READ_FAILED 0xFFFF     /*< readTemplate() result once the template can't be read any further */
+#define HOST_LINK_TEMPLATE_MAX 512       /*< Largest template the host may send, a full sensor character buffer */
+
+/**
+ * Enumeration defining the frame types of the management link
+ * Frame: HOST_LINK_SYNC, type, payload length, payload, 8-bit sum of type, length and payload
+ */
+typedef enum HOST_LINK_MSG : uint8_t
+{
+  HOST_MSG_FEATURES = 0x01, /*< Controller -> host: a chunk of the unmatched feature template */
+  HOST_MSG_LOOKUP   = 0x02, /*< Controller -> host: features complete (length, 2 bytes), match the last length bytes sent */
+  HOST_MSG_PULL     = 0x03, /*< Controller -> host: send the next template bytes (count, 1 byte) */
+  HOST_MSG_HEALTH   = 0x04, /*< Controller -> host: sensor health (latency ms 2, error % 1, pings 2, unanswered 2, recoveries 2, baud/9600 1) */
+  HOST_MSG_PING     = 0x80, /*< Host -> controller: keep-alive */
+  HOST_MSG_MATCH    = 0x81, /*< Host -> controller: lookup matched (template length, 2 bytes) */
+  HOST_MSG_NO_MATCH = 0x82, /*< Host -> controller: lookup didn't match */
+  HOST_MSG_DATA     = 0x83  /*< Host -> controller: template bytes answering a pull */
+} HostLinkMsg_t;
+
+/**
+ * Enumeration defining the state of a host lookup
+ */
+typedef enum HOST_LOOKUP : uint8_t
+{
+  HOST_LOOKUP_IDLE,     /*< No lookup requested */
+  HOST_LOOKUP_PENDING,  /*< Waiting for the host to answer */
+  HOST_LOOKUP_MATCH,    /*< The host matched, its template is read from it with readTemplate() */
+  HOST_LOOKUP_NO_MATCH, /*< The host doesn't know the fingerprint */
+  HOST_LOOKUP_FAILED    /*< The host didn't answer in time, or its template doesn't fit */
+} HostLookup_t;
+
+/**
+ * A class implementing the controller side of the management link
+ * 
+ * Frames are parsed a byte at a time from the link loop, so waiting for the host never blocks the system loop.
+ * A matched template is never held whole, it is pulled a frame at a time as readTemplate() hands it to the sensor.
+ * The link shares its port with the DEBUG_* output, which corrupts frames while it is enabled
+ */
+class AccessCtlHostLink
+{
+private:
+    Stream *port = NULL;                          /*< Serial port of the link */
+    uint8_t rxState = 0;                          /*< Frame parser position: sync, type, length, payload, sum */
+    uint8_t rxType = 0;                           /*< Type of the frame being parsed */
+    uint8_t rxLength = 0;                         /*< Payload length of the frame being parsed */
+    uint8_t rxCount = 0;                          /*< Payload bytes of the frame parsed so far */
+    uint8_t rxSum = 0;                            /*< Running sum of the frame being parsed */
+    uint8_t rxPayload[HOST_LINK_MAX_PAYLOAD];     /*< Payload of the frame being parsed */
+    unsigned long lastHeardMillis = 0;            /*< Time of the last frame from the host */
+    bool heard = false;                           /*< A frame was received from the host */
+    uint16_t featureBytes = 0;                    /*< Feature bytes sent for the next lookup */
+    HostLookup_t lookupState = HOST_LOOKUP_IDLE;  /*< State of the lookup in progress */
+    unsigned long lookupMillis = 0;               /*< Time the lookup was requested */
+    uint16_t matchLength = 0;                     /*< Template length reported by the host */
+    uint16_t templateBytes = 0;                   /*< Template bytes pulled so far */
+    bool pullPending = false;                     /*< A template data request is waiting for its answer */
+    unsigned long pullMillis = 0;                 /*< Time the last template data request was sent */
+    uint8_t chunk[HOST_LINK_MAX_PAYLOAD];         /*< Template bytes of the last answer, not yet read */
+    uint8_t chunkLength = 0;                      /*< Bytes in chunk */
+    uint8_t chunkRead = 0;                        /*< Bytes of chunk taken by readTemplate() */
+
+    /**
+     * @brief	 Parses one byte received from the host
+     * 
+     * @param byte 
+     * @return none
+     */
+    void parseByte(uint8_t byte);
+
+    /**
+     * @brief	 Acts on a complete frame received from the host
+     * 
+     * @param none
+     * @return none
+     */
+    void handleFrame(void);
+
+    /**
+     * @brief	 Asks the host for the next bytes of the matched template
+     * 
+     * @param none
+     * @return none
+     */
+    void requestData(void);
+
+public:
+    /**
+     * @brief	Constructor for the management link
+     * 
+     * @param none
+     * @return none
+     */
+    AccessCtlHostLink(void) {}
+
+    /**
+     * @brief	Destroy the Access Ctl Host Link object
+     */
+    ~AccessCtlHostLink(void) {}
+
+    /**
+     * @brief	 Attaches the link to a serial port, already started
+     * 
+     * @param port 
+     * @return none
+     */
+    void begin(Stream *port);
+
+    /**
+     * @brief	 Link loop, parses the frames received from the host
+     * 
+     * @param none
+     * @return none
+     */
+    void linkLoop(void);
+
+    /**
+     * @brief	Checks whether the host was heard from recently enough to be asked
+     * 
+     * @return bool 
+     */
+    bool online(void);
+
+    /**
+     * @brief	 Sends a frame to the host
+     * 
+     * @param type 
+     * @param payload 
+     * @param length 
+     * @return none
+     */
+    void sendFrame(uint8_t type, const uint8_t *payload, uint8_t length);
+
+    /**
+     * @brief	 Sends a chunk of the feature template to look up, as it is uploaded from the sensor
+     * 
+     * @param data 
+     * @param length 
+     * @return none
+     */
+    void sendFeatures(const uint8_t *data, uint16_t length);
+
+    /**
+     * @brief	 Starts the features of a new lookup
+     * 
+     * @param none
+     * @return none
+     */
+    void beginLookup(void) { featureBytes = 0; }
+
+    /**
+     * @brief	 Asks the host to match the features sent
+     * 
+     * @param none
+     * @return none
+     */
+    void requestLookup(void);
+
+    /**
+     * @brief	Returns the state of the lookup, timing it out if the host took too long to answer or to send the
+     *          next template bytes. A finished lookup stays reported until the next request
+     * 
+     * @return HostLookup_t 
+     */
+    HostLookup_t lookup(void);
+
+    /**
+     * @brief	Returns the length of the template the host matched
+     * 
+     * @return uint16_t 
+     */
+    uint16_t templateLength(void) { return matchLength; }
+
+    /**
+     * @brief	Takes the next bytes of the matched template, asking the host for more once they are used up
+     * 
+     * @param data 
+     * @param length 
+     * @return uint16_t -> bytes copied, 0 while the host hasn't sent them yet
+     * @return HOST_LINK_READ_FAILED -> The host stopped answering, the rest of the template won't come
+     */
+    uint16_t readTemplate(uint8_t *data, uint16_t length);
+};
+
+#endif
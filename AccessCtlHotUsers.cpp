@@ -0,0 +1,267 @@
+/**
+ * @file 		AccessCtlHotUsers.cpp
+ *
+ * @author 		Stephen Kairu (kairu@pheenek.com)
+ *
+ * @brief	    This file contains the implementations for the hot-user tier of the fingerprint library
+ *
+ * @version 	0.1
+ *
+ * @date 		2026-10-16
+ *
+ * ***************************************************************************
+ * @copyright Copyright (c) 2023, Stephen Kairu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the “Software”), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ***************************************************************************
+ *
+ */
+#include "AccessCtlHotUsers.h"
+
+/**
+ * @brief	Constructor for the hot-user tier
+ * 
+ * @param none
+ * @return none
+ */
+AccessCtlHotUsers::AccessCtlHotUsers(void)
+{
+    for (uint8_t i = 0; i < HOT_USER_TRACKED; i++)
+    {
+        hitTable[i].userId = HOT_USER_NONE;
+        hitTable[i].hits = 0;
+    }
+
+    for (uint8_t i = 0; i < HOT_USER_SLOTS; i++)
+    {
+        swapMap[i] = HOT_USER_NONE;
+    }
+
+    pending.hotSlot = HOT_USER_NONE;
+}
+
+/**
+ * @brief	 Loads the slot map from storage
+ *          A map that doesn't hold disjoint pairs is discarded
+ * 
+ * @param storage 
+ * @return none
+ */
+void AccessCtlHotUsers::begin(AccessCtlOnboardStorage *storage)
+{
+    this->storage = storage;
+    storage->getHotSlotMap(swapMap, HOT_USER_SLOTS);
+
+    uint8_t data[HOT_USER_SWAP_BYTES];
+    storage->getHotSlotSwap(data, HOT_USER_SWAP_BYTES);
+    pending.hotSlot = ((uint16_t)data[0] << 8) | data[1];
+    pending.location = ((uint16_t)data[2] << 8) | data[3];
+    pending.scratch = ((uint16_t)data[4] << 8) | data[5];
+    pending.flags = data[6];
+    pending.step = data[7];
+    if ((pending.hotSlot >= HOT_USER_SLOTS) || (pending.location < HOT_USER_SLOTS) || (pending.location == HOT_USER_NONE))
+    {
+        pending.hotSlot = HOT_USER_NONE;
+    }
+
+    for (uint8_t i = 0; i < HOT_USER_SLOTS; i++)
+    {
+        if (swapMap[i] == HOT_USER_NONE) continue;
+
+        // a hot slot can only pair with a location outside the tier, and each location only once
+        bool valid = (swapMap[i] >= HOT_USER_SLOTS);
+        for (uint8_t j = 0; j < i; j++)
+        {
+            if (swapMap[j] == swapMap[i]) valid = false;
+        }
+
+        if (!valid)
+        {
+            for (uint8_t j = 0; j < HOT_USER_SLOTS; j++) swapMap[j] = HOT_USER_NONE;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief	Returns the location/ID paired with the one passed in, or the same value if it isn't paired
+ * 
+ * @param id 
+ * @return uint16_t 
+ */
+uint16_t AccessCtlHotUsers::exchanged(uint16_t id)
+{
+    if (id < HOT_USER_SLOTS)
+    {
+        return (swapMap[id] == HOT_USER_NONE) ? id : swapMap[id];
+    }
+
+    for (uint8_t i = 0; i < HOT_USER_SLOTS; i++)
+    {
+        if (swapMap[i] == id) return i;
+    }
+
+    return id;
+}
+
+/**
+ * @brief	Returns the recorded hits of a user, 0 if not tracked
+ * 
+ * @param userId 
+ * @return uint16_t 
+ */
+uint16_t AccessCtlHotUsers::getHits(uint16_t userId)
+{
+    for (uint8_t i = 0; i < HOT_USER_TRACKED; i++)
+    {
+        if (hitTable[i].userId == userId) return hitTable[i].hits;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief	 Records a successful verification of a user
+ *          An untracked user takes over the least hit entry and inherits its count, so a newly frequent user
+ *          catches up with the tracked ones instead of starting from zero
+ * 
+ * @param userId 
+ * @return none
+ */
+void AccessCtlHotUsers::recordHit(uint16_t userId)
+{
+    uint8_t entry = 0;
+
+    for (uint8_t i = 0; i < HOT_USER_TRACKED; i++)
+    {
+        if (hitTable[i].userId == userId)
+        {
+            entry = i;
+            break;
+        }
+        if (hitTable[i].hits < hitTable[entry].hits) entry = i;
+    }
+
+    hitTable[entry].userId = userId;
+
+    // age all the counters before they overflow, recent use matters more than old use
+    if (++hitTable[entry].hits == 0xFFFF)
+    {
+        for (uint8_t i = 0; i < HOT_USER_TRACKED; i++) hitTable[i].hits >>= 1;
+    }
+}
+
+/**
+ * @brief	Plans the next template exchange that moves a frequent user into the hot tier
+ *          A hot slot already paired is first restored, so pairs never overlap
+ * 
+ * @param swap 
+ * @return true -> An exchange is due, described in swap
+ * @return false -> The hot tier already holds the most frequent users
+ */
+bool AccessCtlHotUsers::planSwap(HotUserSwap_t *swap)
+{
+    // the most frequent user that lives outside the hot tier
+    uint8_t best = HOT_USER_TRACKED;
+    for (uint8_t i = 0; i < HOT_USER_TRACKED; i++)
+    {
+        if ((hitTable[i].userId == HOT_USER_NONE) || (hitTable[i].hits < HOT_USER_MIN_HITS)) continue;
+        if (toLocation(hitTable[i].userId) < HOT_USER_SLOTS) continue;
+        if ((best == HOT_USER_TRACKED) || (hitTable[i].hits > hitTable[best].hits)) best = i;
+    }
+    if (best == HOT_USER_TRACKED) return false;
+
+    uint16_t userId = hitTable[best].userId;
+    uint16_t hits = hitTable[best].hits;
+
+    if (userId < HOT_USER_SLOTS)
+    {
+        // a user enrolled in the hot tier that was displaced, send it home
+        if (hits < (getHits(toUserId(userId)) + HOT_USER_MARGIN)) return false;
+        swap->hotSlot = userId;
+        swap->location = swapMap[userId];
+        swap->flags = HOT_SWAP_RESTORE;
+        return true;
+    }
+
+    // displace the least used resident of the hot tier
+    uint8_t coldest = 0;
+    for (uint8_t i = 1; i < HOT_USER_SLOTS; i++)
+    {
+        if (getHits(toUserId(i)) < getHits(toUserId(coldest))) coldest = i;
+    }
+    if (hits < (getHits(toUserId(coldest)) + HOT_USER_MARGIN)) return false;
+
+    swap->hotSlot = coldest;
+    swap->location = (swapMap[coldest] == HOT_USER_NONE) ? userId : swapMap[coldest];
+    swap->flags = (swapMap[coldest] == swap->location) ? HOT_SWAP_RESTORE : 0;
+    return true;
+}
+
+/**
+ * @brief	 Persists an exchange in progress, before its first store and after each store the sensor acknowledges
+ * 
+ * @param swap 
+ * @return none
+ */
+void AccessCtlHotUsers::saveSwap(const HotUserSwap_t *swap)
+{
+    if (!storage) return;
+
+    uint8_t data[HOT_USER_SWAP_BYTES] = {
+        (uint8_t)(swap->hotSlot >> 8), (uint8_t)(swap->hotSlot & 0xFF),
+        (uint8_t)(swap->location >> 8), (uint8_t)(swap->location & 0xFF),
+        (uint8_t)(swap->scratch >> 8), (uint8_t)(swap->scratch & 0xFF),
+        swap->flags, swap->step};
+    storage->saveHotSlotSwap(data, HOT_USER_SWAP_BYTES);
+}
+
+/**
+ * @brief	 Returns the exchange that was still in progress when the map was loaded
+ * 
+ * @param swap 
+ * @return true -> An exchange has to be finished, described in swap
+ * @return false -> No exchange was interrupted
+ */
+bool AccessCtlHotUsers::pendingSwap(HotUserSwap_t *swap)
+{
+    if (pending.hotSlot == HOT_USER_NONE) return false;
+
+    *swap = pending;
+    return true;
+}
+
+/**
+ * @brief	 Records an exchange completed on the sensor, persists the map and drops the saved exchange
+ *          Safe to repeat, the map entry is set rather than toggled
+ * 
+ * @param swap 
+ * @return none
+ */
+void AccessCtlHotUsers::commitSwap(const HotUserSwap_t *swap)
+{
+    swapMap[swap->hotSlot] = (swap->flags & HOT_SWAP_RESTORE) ? HOT_USER_NONE : swap->location;
+    pending.hotSlot = HOT_USER_NONE;
+
+    if (!storage) return;
+    storage->saveHotSlotMap(swapMap, HOT_USER_SLOTS);
+
+    // the map is saved first, an exchange interrupted in between is committed again
+    uint8_t cleared[HOT_USER_SWAP_BYTES];
+    memset(cleared, 0xFF, sizeof(cleared));
+    storage->saveHotSlotSwap(cleared, HOT_USER_SWAP_BYTES);
+}
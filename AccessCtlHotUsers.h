@@ -0,0 +1,187 @@
+/**
+ * @file 		AccessCtlHotUsers.h
+ *
+ * @author 		Stephen Kairu (kairu@pheenek.com)
+ *
+ * @brief	    This file contains the definitions for the hot-user tier of the fingerprint library
+ *            The most frequent users are moved into a small page range that is searched first
+ *
+ * @version 	0.1
+ *
+ * @date 		2026-10-16
+ *
+ * ***************************************************************************
+ * @copyright Copyright (c) 2023, Stephen Kairu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the “Software”), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ***************************************************************************
+ *
+ */
+#ifndef ACCESS_CTL_HOT_USERS_H
+#define ACCESS_CTL_HOT_USERS_H
+
+#include <stdint.h>
+#include "AccessCtlOnboardStorage.h"
+
+#define HOT_USER_SLOTS 8     /*< Library pages 0 - (HOT_USER_SLOTS - 1) form the hot tier */
+#define HOT_USER_TRACKED 8   /*< Number of users the hit counters track */
+#define HOT_USER_MIN_HITS 4  /*< Hits a user needs before being promoted into the hot tier */
+#define HOT_USER_MARGIN 2    /*< Hits a user needs over the resident it displaces, stops slots trading back and forth */
+#define HOT_USER_NONE 0xFFFF /*< No user/location */
+#define HOT_USER_SWAP_BYTES 8 /*< Size of an exchange in progress as persisted */
+
+#define HOT_SWAP_HOT_USED 0x01   /*< The hot slot held a template when the exchange was planned */
+#define HOT_SWAP_OTHER_USED 0x02 /*< The other location held a template when the exchange was planned */
+#define HOT_SWAP_RESTORE 0x04    /*< The exchange restores a pair, the hot slot is unpaired once done */
+
+/**
+ * Hit counter of a single user
+ */
+typedef struct HOT_USER_HITS
+{
+    uint16_t userId; /*< User ID (template ID given at enrollment) */
+    uint16_t hits;   /*< Successful verifications, approximate */
+} HotUserHits_t;
+
+/**
+ * A pair of library locations whose templates are to be exchanged, and the progress of the exchange
+ * Persisted while the exchange runs, so one interrupted by a failure or a power loss can be finished
+ */
+typedef struct HOT_USER_SWAP
+{
+    uint16_t hotSlot;  /*< Location in the hot tier */
+    uint16_t location; /*< Location outside the hot tier */
+    uint16_t scratch;  /*< Free location keeping a copy of the hot slot template while both are overwritten, HOT_USER_NONE if not needed */
+    uint8_t flags;     /*< HOT_SWAP_* flags */
+    uint8_t step;      /*< Step the exchange resumes at, everything before it was acknowledged by the sensor */
+} HotUserSwap_t;
+
+/**
+ * A class keeping the hit counters of the fingerprint users, and the map of users moved into or out of the hot tier
+ * 
+ * Users keep the ID they were enrolled with. Promoting a user exchanges the templates at a hot slot and the user's
+ * location, so the map only ever holds disjoint pairs, and translating an ID to a location and back is the same lookup
+ */
+class AccessCtlHotUsers
+{
+private:
+    HotUserHits_t hitTable[HOT_USER_TRACKED]; /*< Hit counters of the most frequent users (space-saving: the least hit entry is recycled) */
+    uint16_t swapMap[HOT_USER_SLOTS];          /*< Location each hot slot is exchanged with, HOT_USER_NONE if in place */
+    AccessCtlOnboardStorage *storage = NULL;   /*< Storage the map is persisted to */
+    HotUserSwap_t pending;                     /*< Exchange found unfinished in storage, hotSlot is HOT_USER_NONE if there is none */
+
+    /**
+     * @brief	Returns the recorded hits of a user, 0 if not tracked
+     * 
+     * @param userId 
+     * @return uint16_t 
+     */
+    uint16_t getHits(uint16_t userId);
+
+public:
+    /**
+     * @brief	Constructor for the hot-user tier
+     * 
+     * @param none
+     * @return none
+     */
+    AccessCtlHotUsers(void);
+
+    /**
+     * @brief	Destroy the Access Ctl Hot Users object
+     */
+    ~AccessCtlHotUsers(void) {}
+
+    /**
+     * @brief	 Loads the slot map from storage
+     *          A map that doesn't hold disjoint pairs is discarded
+     * 
+     * @param storage 
+     * @return none
+     */
+    void begin(AccessCtlOnboardStorage *storage);
+
+    /**
+     * @brief	Translates a user ID to the library location holding the user's template
+     * 
+     * @param userId 
+     * @return uint16_t 
+     */
+    uint16_t toLocation(uint16_t userId) { return exchanged(userId); }
+
+    /**
+     * @brief	Translates a library location to the ID of the user whose template it holds
+     * 
+     * @param location 
+     * @return uint16_t 
+     */
+    uint16_t toUserId(uint16_t location) { return exchanged(location); }
+
+    /**
+     * @brief	Returns the location/ID paired with the one passed in, or the same value if it isn't paired
+     * 
+     * @param id 
+     * @return uint16_t 
+     */
+    uint16_t exchanged(uint16_t id);
+
+    /**
+     * @brief	 Records a successful verification of a user
+     * 
+     * @param userId 
+     * @return none
+     */
+    void recordHit(uint16_t userId);
+
+    /**
+     * @brief	Plans the next template exchange that moves a frequent user into the hot tier
+     *          A hot slot already paired is first restored, so pairs never overlap
+     * 
+     * @param swap 
+     * @return true -> An exchange is due, described in swap
+     * @return false -> The hot tier already holds the most frequent users
+     */
+    bool planSwap(HotUserSwap_t *swap);
+
+    /**
+     * @brief	 Persists an exchange in progress, before its first store and after each store the sensor acknowledges
+     * 
+     * @param swap 
+     * @return none
+     */
+    void saveSwap(const HotUserSwap_t *swap);
+
+    /**
+     * @brief	 Returns the exchange that was still in progress when the map was loaded
+     * 
+     * @param swap 
+     * @return true -> An exchange has to be finished, described in swap
+     * @return false -> No exchange was interrupted
+     */
+    bool pendingSwap(HotUserSwap_t *swap);
+
+    /**
+     * @brief	 Records an exchange completed on the sensor, persists the map and drops the saved exchange
+     *          Safe to repeat, the map entry is set rather than toggled
+     * 
+     * @param swap 
+     * @return none
+     */
+    void commitSwap(const HotUserSwap_t *swap);
+};
+
+#endif
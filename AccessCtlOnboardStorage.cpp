@@ -106,3 +106,93 @@ void AccessCtlOnboardStorage::getPIN(char *pinBuf)
 {
     strcpy(pinBuf, devicePIN);
 }
+
+/**
+ * @brief	 Reads the hot fingerprint slot map from the EEPROM into the buffer provided
+ *          Entries never written read back as 0xFFFF
+ * 
+ * @param map 
+ * @param count 
+ * @return none
+ */
+void AccessCtlOnboardStorage::getHotSlotMap(uint16_t *map, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        map[i] = ((uint16_t)EEPROM.read(hotSlotMapAddress + (2 * i)) << 8) | EEPROM.read(hotSlotMapAddress + (2 * i) + 1);
+    }
+}
+
+/**
+ * @brief	 Saves the hot fingerprint slot map into the EEPROM
+ *          Only bytes that changed are written, to spare the EEPROM
+ * 
+ * @param map 
+ * @param count 
+ * @return none
+ */
+void AccessCtlOnboardStorage::saveHotSlotMap(const uint16_t *map, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        EEPROM.update(hotSlotMapAddress + (2 * i), map[i] >> 8);
+        EEPROM.update(hotSlotMapAddress + (2 * i) + 1, map[i] & 0xFF);
+    }
+}
+
+/**
+ * @brief	 Reads the hot fingerprint slot exchange in progress from the EEPROM into the buffer provided
+ *          Reads back as 0xFF bytes if never written
+ * 
+ * @param data 
+ * @param length 
+ * @return none
+ */
+void AccessCtlOnboardStorage::getHotSlotSwap(uint8_t *data, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+        data[i] = EEPROM.read(hotSlotSwapAddress + i);
+    }
+}
+
+/**
+ * @brief	 Saves the hot fingerprint slot exchange in progress into the EEPROM
+ *          Only bytes that changed are written, to spare the EEPROM
+ * 
+ * @param data 
+ * @param length 
+ * @return none
+ */
+void AccessCtlOnboardStorage::saveHotSlotSwap(const uint8_t *data, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+        EEPROM.update(hotSlotSwapAddress + i, data[i]);
+    }
+}
+
+/**
+ * @brief	 Reads the fingerprint template count last saved
+ *          Reads back as 0xFFFF if never written
+ * 
+ * @param none
+ * @return uint16_t 
+ */
+uint16_t AccessCtlOnboardStorage::getTemplateCount(void)
+{
+    return ((uint16_t)EEPROM.read(templateCountAddress) << 8) | EEPROM.read(templateCountAddress + 1);
+}
+
+/**
+ * @brief	 Saves the fingerprint template count into the EEPROM
+ *          Only bytes that changed are written, to spare the EEPROM
+ * 
+ * @param count 
+ * @return none
+ */
+void AccessCtlOnboardStorage::saveTemplateCount(uint16_t count)
+{
+    EEPROM.update(templateCountAddress, count >> 8);
+    EEPROM.update(templateCountAddress + 1, count & 0xFF);
+}
@@ -49,6 +49,9 @@ class AccessCtlOnboardStorage
 private:
     const int PIN_SIZE = 4;                /*< Length of the security code (PIN)*/
     const uint16_t pinStorageAddress = 16; /*< Address to which the security code is stored on the EEPROM*/
+    const uint16_t hotSlotMapAddress = 32; /*< Address to which the hot fingerprint slot map is stored on the EEPROM*/
+    const uint16_t templateCountAddress = 48; /*< Address to which the fingerprint template count is stored on the EEPROM*/
+    const uint16_t hotSlotSwapAddress = 52; /*< Address to which the hot fingerprint slot exchange in progress is stored on the EEPROM*/
     const char *defaultPIN = "1234";       /*< Default security code (PIN) */
     char devicePIN[5];                     /*< PIN (security code) buffer. Stores the current PIN (security code) in RAM */
 
@@ -92,6 +95,64 @@ public:
      * @return none
      */
     void savePIN(char *pinBuf);
+
+    /**
+     * @brief	 Reads the hot fingerprint slot map from the EEPROM into the buffer provided
+     *          Entries never written read back as 0xFFFF
+     *
+     * @param map
+     * @param count
+     * @return none
+     */
+    void getHotSlotMap(uint16_t *map, uint8_t count);
+
+    /**
+     * @brief	 Saves the hot fingerprint slot map into the EEPROM
+     *          Only bytes that changed are written, to spare the EEPROM
+     *
+     * @param map
+     * @param count
+     * @return none
+     */
+    void saveHotSlotMap(const uint16_t *map, uint8_t count);
+
+    /**
+     * @brief	 Reads the hot fingerprint slot exchange in progress from the EEPROM into the buffer provided
+     *          Reads back as 0xFF bytes if never written
+     *
+     * @param data
+     * @param length
+     * @return none
+     */
+    void getHotSlotSwap(uint8_t *data, uint8_t length);
+
+    /**
+     * @brief	 Saves the hot fingerprint slot exchange in progress into the EEPROM
+     *          Only bytes that changed are written, to spare the EEPROM
+     *
+     * @param data
+     * @param length
+     * @return none
+     */
+    void saveHotSlotSwap(const uint8_t *data, uint8_t length);
+
+    /**
+     * @brief	 Reads the fingerprint template count last saved
+     *          Reads back as 0xFFFF if never written
+     *
+     * @param none
+     * @return uint16_t
+     */
+    uint16_t getTemplateCount(void);
+
+    /**
+     * @brief	 Saves the fingerprint template count into the EEPROM
+     *          Only bytes that changed are written, to spare the EEPROM
+     *
+     * @param count
+     * @return none
+     */
+    void saveTemplateCount(uint16_t count);
 };
 
 #endif
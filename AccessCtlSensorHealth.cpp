@@ -0,0 +1,108 @@
+/**
+ * @file 		AccessCtlSensorHealth.cpp
+ *
+ * @author 		Stephen Kairu (kairu@pheenek.com)
+ *
+ * @brief	    This file contains the implementations for the fingerprint sensor health monitor
+ *
+ * @version 	0.1
+ *
+ * @date 		2026-10-16
+ *
+ * ***************************************************************************
+ * @copyright Copyright (c) 2023, Stephen Kairu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the “Software”), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ***************************************************************************
+ *
+ */
+#include "AccessCtlSensorHealth.h"
+
+/**
+ * @brief	 Starts the averages afresh, from the sensor command counters as they are now
+ * 
+ * @param commands 
+ * @param failures 
+ * @return none
+ */
+void AccessCtlSensorHealth::begin(uint16_t commands, uint16_t failures)
+{
+    latencyQ4 = 0;
+    errorQ8 = 0;
+    seeded = false;
+    commandsSeen = commands;
+    failuresSeen = failures;
+}
+
+/**
+ * @brief	 Records the outcome of a ping
+ *          Its failure is counted through the command counters, like any other command
+ * 
+ * @param answered 
+ * @param latencyMs 
+ * @return none
+ */
+void AccessCtlSensorHealth::recordPing(bool answered, uint16_t latencyMs)
+{
+    pings++;
+    if (!answered)
+    {
+        pingFailures++;
+        return;
+    }
+
+    int32_t sample = (int32_t)latencyMs << 4;
+    if (!seeded)
+    {
+        latencyQ4 = sample;
+        seeded = true;
+        return;
+    }
+    latencyQ4 += (sample - latencyQ4) / 8;
+}
+
+/**
+ * @brief	 Records the commands completed since the last call, from the sensor command counters
+ *          The order of the failures among them is unknown, so they are applied last, weighing them
+ *          the most
+ * 
+ * @param commands 
+ * @param failures 
+ * @return none
+ */
+void AccessCtlSensorHealth::recordCommands(uint16_t commands, uint16_t failures)
+{
+    uint16_t completed = commands - commandsSeen;
+    uint16_t failed = failures - failuresSeen;
+    commandsSeen = commands;
+    failuresSeen = failures;
+
+    if (failed > completed) failed = completed;
+    for (uint16_t i = failed; i < completed; i++) errorQ8 += (0 - errorQ8) >> 2;
+    for (uint16_t i = 0; i < failed; i++) errorQ8 += (256 - errorQ8) >> 2;
+}
+
+/**
+ * @brief	Checks whether the averages call for the sensor to be re-initialised
+ * 
+ * @return bool 
+ */
+bool AccessCtlSensorHealth::unhealthy(void)
+{
+    if (errorQ8 >= SENSOR_HEALTH_MAX_ERRORS) return true;
+    return seeded && (latency() >= SENSOR_HEALTH_MAX_LATENCY_MS);
+}
@@ -0,0 +1,125 @@
+/**
+ * @file 		AccessCtlSensorHealth.h
+ *
+ * @author 		Stephen Kairu (kairu@pheenek.com)
+ *
+ * @brief	    This file contains the definitions for the fingerprint sensor health monitor
+ *            The sensor is pinged while idle, and a sensor that browned out or lost sync is re-initialised
+ *
+ * @version 	0.1
+ *
+ * @date 		2026-10-16
+ *
+ * ***************************************************************************
+ * @copyright Copyright (c) 2023, Stephen Kairu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the “Software”), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ***************************************************************************
+ *
+ */
+#ifndef ACCESS_CTL_SENSOR_HEALTH_H
+#define ACCESS_CTL_SENSOR_HEALTH_H
+
+#include <stdint.h>
+
+#define SENSOR_HEALTH_PING_MS 5000       /*< Time between pings of an idle sensor */
+#define SENSOR_HEALTH_MAX_LATENCY_MS 250 /*< Average ping latency that calls for recovery */
+#define SENSOR_HEALTH_MAX_ERRORS 128     /*< Average command failure rate, out of 256, that calls for recovery */
+
+/**
+ * A class keeping exponentially weighted moving averages of the sensor ping latency and command failure rate
+ * 
+ * The averages are fixed point: the latency in 1/16 ms with a weight of 1/8 per ping, the failure rate out of 256 with
+ * a weight of 1/4 per command, so three failures in a row are enough to call for recovery
+ */
+class AccessCtlSensorHealth
+{
+private:
+    int32_t latencyQ4 = 0;       /*< Average ping latency, 1/16 ms */
+    int16_t errorQ8 = 0;         /*< Average command failure rate, out of 256 */
+    bool seeded = false;         /*< The latency average holds a ping */
+    uint16_t commandsSeen = 0;   /*< Sensor command count last sampled */
+    uint16_t failuresSeen = 0;   /*< Sensor command failure count last sampled */
+
+public:
+    uint16_t pings = 0;        /*< Pings sent */
+    uint16_t pingFailures = 0; /*< Pings that got no answer */
+    uint16_t recoveries = 0;   /*< Times the sensor was re-initialised */
+
+    /**
+     * @brief	Constructor for the sensor health monitor
+     * 
+     * @param none
+     * @return none
+     */
+    AccessCtlSensorHealth(void) {}
+
+    /**
+     * @brief	Destroy the Access Ctl Sensor Health object
+     */
+    ~AccessCtlSensorHealth(void) {}
+
+    /**
+     * @brief	 Starts the averages afresh, from the sensor command counters as they are now
+     * 
+     * @param commands 
+     * @param failures 
+     * @return none
+     */
+    void begin(uint16_t commands, uint16_t failures);
+
+    /**
+     * @brief	 Records the outcome of a ping
+     * 
+     * @param answered 
+     * @param latencyMs 
+     * @return none
+     */
+    void recordPing(bool answered, uint16_t latencyMs);
+
+    /**
+     * @brief	 Records the commands completed since the last call, from the sensor command counters
+     * 
+     * @param commands 
+     * @param failures 
+     * @return none
+     */
+    void recordCommands(uint16_t commands, uint16_t failures);
+
+    /**
+     * @brief	Checks whether the averages call for the sensor to be re-initialised
+     * 
+     * @return bool 
+     */
+    bool unhealthy(void);
+
+    /**
+     * @brief	Returns the average ping latency in ms
+     * 
+     * @return uint16_t 
+     */
+    uint16_t latency(void) { return latencyQ4 >> 4; }
+
+    /**
+     * @brief	Returns the average command failure rate in percent
+     * 
+     * @return uint8_t 
+     */
+    uint8_t errorPercent(void) { return ((uint16_t)errorQ8 * 100) >> 8; }
+};
+
+#endif
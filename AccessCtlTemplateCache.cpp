@@ -0,0 +1,122 @@
+/**
+ * @file 		AccessCtlTemplateCache.cpp
+ *
+ * @author 		Stephen Kairu (kairu@pheenek.com)
+ *
+ * @brief	    This file contains the implementations for the recency tracking of the fingerprint library
+ *
+ * @version 	0.1
+ *
+ * @date 		2026-10-16
+ *
+ * ***************************************************************************
+ * @copyright Copyright (c) 2023, Stephen Kairu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the “Software”), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ***************************************************************************
+ *
+ */
+#include "AccessCtlTemplateCache.h"
+
+/**
+ * @brief	Constructor for the template cache
+ * 
+ * @param none
+ * @return none
+ */
+AccessCtlTemplateCache::AccessCtlTemplateCache(void)
+{
+    memset(referenced, 0, sizeof(referenced));
+}
+
+/**
+ * @brief	 Attaches the cache to the library index and the hot tier
+ * 
+ * @param index 
+ * @param hotUsers 
+ * @return none
+ */
+void AccessCtlTemplateCache::begin(FingerprintIndex *index, AccessCtlHotUsers *hotUsers)
+{
+    this->index = index;
+    this->hotUsers = hotUsers;
+    hand = 0;
+}
+
+/**
+ * @brief	 Records a use of the template at a location
+ * 
+ * @param location 
+ * @return none
+ */
+void AccessCtlTemplateCache::touch(uint16_t location)
+{
+    if (location >= FINGERPRINT_INDEX_MAX) return;
+
+    referenced[location >> 3] |= (1 << (location & 7));
+}
+
+/**
+ * @brief	Checks whether a location may be evicted
+ * 
+ * @param location 
+ * @return bool 
+ */
+bool AccessCtlTemplateCache::pinned(uint16_t location)
+{
+    return (location < HOT_USER_SLOTS) || (hotUsers->exchanged(location) != location);
+}
+
+/**
+ * @brief	Picks the location for a template fetched from the host
+ *          A free location is used first, otherwise the clock hand sweeps the library: a referenced location
+ *          gets its bit cleared and is passed over, the first unreferenced one is evicted. Two sweeps always
+ *          find one unless every location is pinned
+ * 
+ * @param evict -> set true if the location holds a template that has to be deleted first
+ * @return uint16_t -> the location, FINGERPRINT_INDEX_NONE if every location is pinned
+ */
+uint16_t AccessCtlTemplateCache::victim(bool *evict)
+{
+    *evict = false;
+    if ((index == NULL) || (hotUsers == NULL)) return FINGERPRINT_INDEX_NONE;
+
+    uint16_t location = index->allocate();
+    if (location != FINGERPRINT_INDEX_NONE) return location;
+
+    uint16_t capacity = index->capacity();
+    for (uint32_t step = 0; step < 2UL * capacity; step++)
+    {
+        if (hand >= capacity) hand = 0;
+        location = hand++;
+
+        if (pinned(location)) continue;
+
+        uint8_t mask = (1 << (location & 7));
+        if (referenced[location >> 3] & mask)
+        {
+            referenced[location >> 3] &= ~mask;
+            continue;
+        }
+
+        evictions++;
+        *evict = true;
+        return location;
+    }
+
+    return FINGERPRINT_INDEX_NONE;
+}
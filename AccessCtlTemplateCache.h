@@ -0,0 +1,108 @@
+/**
+ * @file 		AccessCtlTemplateCache.h
+ *
+ * @author 		Stephen Kairu (kairu@pheenek.com)
+ *
+ * @brief	    This file contains the definitions for the recency tracking of the fingerprint library
+ *            The sensor library is treated as a cache of the host database, the least recently used
+ *            template makes room for one fetched from the host
+ *
+ * @version 	0.1
+ *
+ * @date 		2026-10-16
+ *
+ * ***************************************************************************
+ * @copyright Copyright (c) 2023, Stephen Kairu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the “Software”), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * ***************************************************************************
+ *
+ */
+#ifndef ACCESS_CTL_TEMPLATE_CACHE_H
+#define ACCESS_CTL_TEMPLATE_CACHE_H
+
+#include <stdint.h>
+#include "FingerprintIndex.h"
+#include "AccessCtlHotUsers.h"
+
+/**
+ * A class approximating least-recently-used order over the sensor library with the CLOCK algorithm
+ * 
+ * A timestamp per location wouldn't fit the SRAM, so each location keeps one reference bit, set on use. The clock
+ * hand sweeps the library clearing the bits, and the first location found clear is the one to evict. The hot tier,
+ * and the locations exchanged with it, are never evicted
+ */
+class AccessCtlTemplateCache
+{
+private:
+    uint8_t referenced[FINGERPRINT_INDEX_MAX / 8]; /*< Bit n set if location n was used since the hand last passed */
+    uint16_t hand = 0;                             /*< Next location the clock hand looks at */
+    FingerprintIndex *index = NULL;                /*< Occupancy of the library */
+    AccessCtlHotUsers *hotUsers = NULL;            /*< Hot tier whose locations are pinned */
+
+    /**
+     * @brief	Checks whether a location may be evicted
+     * 
+     * @param location 
+     * @return bool 
+     */
+    bool pinned(uint16_t location);
+
+public:
+    uint16_t evictions = 0; /*< Templates evicted to make room */
+
+    /**
+     * @brief	Constructor for the template cache
+     * 
+     * @param none
+     * @return none
+     */
+    AccessCtlTemplateCache(void);
+
+    /**
+     * @brief	Destroy the Access Ctl Template Cache object
+     */
+    ~AccessCtlTemplateCache(void) {}
+
+    /**
+     * @brief	 Attaches the cache to the library index and the hot tier
+     * 
+     * @param index 
+     * @param hotUsers 
+     * @return none
+     */
+    void begin(FingerprintIndex *index, AccessCtlHotUsers *hotUsers);
+
+    /**
+     * @brief	 Records a use of the template at a location
+     * 
+     * @param location 
+     * @return none
+     */
+    void touch(uint16_t location);
+
+    /**
+     * @brief	Picks the location for a template fetched from the host
+     *          A free location is used first, otherwise the least recently used one
+     * 
+     * @param evict -> set true if the location holds a template that has to be deleted first
+     * @return uint16_t -> the location, FINGERPRINT_INDEX_NONE if every location is pinned
+     */
+    uint16_t victim(bool *evict);
+};
+
+#endif
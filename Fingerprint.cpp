@@ -28,20 +28,17 @@
 
 #include "Fingerprint.h"
 
-//#define FINGERPRINT_DEBUG
+// FINGERPRINT_DEBUG is set in Fingerprint.h, it adds the debug port to the
+// class
 
 /*!
  * @brief Gets the command packet
  */
 #define GET_CMD_PACKET(...)                                                    \
   uint8_t data[] = {__VA_ARGS__};                                              \
-  Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, sizeof(data),  \
-                                     data);                                    \
-  writeStructuredPacket(packet);                                               \
-  if (getStructuredPacket(&packet) != FINGERPRINT_OK)                          \
+  if (runCommand(data, sizeof(data)) != FINGERPRINT_OK)                        \
     return FINGERPRINT_PACKETRECIEVEERR;                                       \
-  if (packet.type != FINGERPRINT_ACKPACKET)                                    \
-    return FINGERPRINT_PACKETRECIEVEERR;
+  Fingerprint_Packet &packet = rxPacket;
 
 /*!
  * @brief Sends the command packet
@@ -50,99 +47,230 @@
   GET_CMD_PACKET(__VA_ARGS__);                                                 \
   return packet.data[0];
 
+/*!
+ * @brief Starts the command packet without waiting for the acknowledge
+ */
+#define BEGIN_CMD_PACKET(callback, ...)                                        \
+  uint8_t data[] = {__VA_ARGS__};                                              \
+  return beginCommand(data, sizeof(data), callback);
+
+/*!
+ * @brief The prebuilt flash frame of a command with constant arguments
+ */
+#define STATIC_CMD_FRAME(...) Fingerprint_StaticPacket<__VA_ARGS__>::frame
+
+/*!
+ * @brief Sends a prebuilt command frame from flash
+ */
+#define SEND_STATIC_CMD_PACKET(...)                                            \
+  if (runCommand_P(STATIC_CMD_FRAME(__VA_ARGS__),                              \
+                   sizeof(STATIC_CMD_FRAME(__VA_ARGS__))) != FINGERPRINT_OK)   \
+    return FINGERPRINT_PACKETRECIEVEERR;                                       \
+  return rxPacket.data[0];
+
+/*!
+ * @brief Starts a prebuilt command frame from flash without waiting for the
+ * acknowledge
+ */
+#define BEGIN_STATIC_CMD_PACKET(callback, ...)                                 \
+  return beginCommand_P(STATIC_CMD_FRAME(__VA_ARGS__),                         \
+                        sizeof(STATIC_CMD_FRAME(__VA_ARGS__)), callback);
+
+/*!
+ * @brief Baud rates a boot handshake scans, over 9600 and most common first
+ */
+static const uint8_t fingerprintBaudScan[] PROGMEM = {
+    FINGERPRINT_BAUDRATE_57600, FINGERPRINT_BAUDRATE_115200,
+    FINGERPRINT_BAUDRATE_9600,  FINGERPRINT_BAUDRATE_19200,
+    FINGERPRINT_BAUDRATE_38400, FINGERPRINT_BAUDRATE_28800,
+    FINGERPRINT_BAUDRATE_48000, FINGERPRINT_BAUDRATE_67200,
+    FINGERPRINT_BAUDRATE_76800, FINGERPRINT_BAUDRATE_86400,
+    FINGERPRINT_BAUDRATE_96000, FINGERPRINT_BAUDRATE_105600};
+
+/*!
+ * @brief Steps of a link negotiation, see negotiateLinkLoop()
+ */
+#define LINK_STEP_IDLE 0     //!< No negotiation in progress
+#define LINK_STEP_BAUD 1     //!< Writing the new baud rate to the sensor
+#define LINK_STEP_PROBE 2    //!< Handshaking at the new rate
+#define LINK_STEP_PACKET 3   //!< Writing the packet length, the rate held
+#define LINK_STEP_UNDO_NEW 4 //!< Putting the sensor back, at the new rate
+#define LINK_STEP_UNDO_OLD 5 //!< Putting the sensor back, at the old rate
+#define LINK_STEP_PARAMS 6   //!< Re-reading the packet length, its write failed
+#define LINK_STEP_FALL_BAUD 7   //!< Writing the safe baud rate to the sensor
+#define LINK_STEP_FALL_PROBE 8  //!< Handshaking at the safe rate
+#define LINK_STEP_FALL_PACKET 9 //!< Restoring the packet length of the safe rate
+
+/*!
+ * @brief Timeout and retry policy of each command, commands not listed take
+ * the last entry. The timeouts allow for a 256-byte packet length at 9600 baud
+ * where data follows, and a full 1000-template library where the sensor scans
+ */
+static const Fingerprint_CmdPolicy fingerprintCmdPolicy[] PROGMEM = {
+    // opcode, latency, timeout, retries
+    {FINGERPRINT_GETIMAGE, 150, 600, 2},
+    {FINGERPRINT_IMAGE2TZ, 300, 800, 1},
+    {FINGERPRINT_MATCH, 50, 300, 2},
+    {FINGERPRINT_SEARCH, 300, 1500, 1},
+    {FINGERPRINT_HISPEEDSEARCH, 150, 1000, 1},
+    {FINGERPRINT_REGMODEL, 100, 500, 1},
+    {FINGERPRINT_STORE, 100, 500, 2},
+    {FINGERPRINT_LOAD, 50, 300, 2},
+    {FINGERPRINT_UPLOAD, 30, 300, 0},
+    {FINGERPRINT_DOWNLOAD, 30, 300, 0},
+    {FINGERPRINT_DELETE, 100, 500, 2},
+    {FINGERPRINT_EMPTY, 1000, 3000, 1},
+    {FINGERPRINT_WRITE_REG, 50, 300, 0},
+    {FINGERPRINT_READSYSPARAM, 20, 150, 2},
+    {FINGERPRINT_VERIFYPASSWORD, 20, 150, 2},
+    {FINGERPRINT_TEMPLATECOUNT, 20, 150, 2},
+    {FINGERPRINT_READINDEXTABLE, 30, 200, 2},
+    {FINGERPRINT_AURALEDCONFIG, 20, 100, 3},
+    {FINGERPRINT_LEDON, 20, 100, 3},
+    {FINGERPRINT_LEDOFF, 20, 100, 3},
+    {0, 100, DEFAULTTIMEOUT, 1}};
+
 /***************************************************************************
  PUBLIC FUNCTIONS
  ***************************************************************************/
 
-#if defined(__AVR__) || defined(ESP8266) || defined(FREEDOM_E300_HIFIVE1)
 /**************************************************************************/
 /*!
-    @brief  Instantiates sensor with Software Serial
-    @param  ss Pointer to FingerprintSerial object
+    @brief  Instantiates sensor over a serial transport
+    @param  transport Pointer to the serial object the sensor is wired to, e.g.
+   FingerprintSensorSerial or FingerprintUart
     @param  password 32-bit integer password (default is 0)
 */
 /**************************************************************************/
-Fingerprint::Fingerprint(FingerprintSerial *ss,
-                                           uint32_t password) {
+template <class Transport>
+Fingerprint<Transport>::Fingerprint(Transport *transport, uint32_t password) {
   thePassword = password;
   theAddress = 0xFFFFFFFF;
 
-  hwSerial = NULL;
-  swSerial = ss;
-  mySerial = swSerial;
-}
+  mySerial = transport;
+#ifdef FINGERPRINT_DEBUG
+#ifdef FINGERPRINT_UART_TRANSPORT
+  debugPort = NULL;
+#else
+  debugPort = &Serial;
 #endif
+#endif
+
+  cmdState = FINGERPRINT_CMD_IDLE;
+  cmdCallback = NULL;
+  cmdStreaming = false;
+  cmdSending = false;
+  rxSink = NULL;
+  txSource = NULL;
+  linkBaud = safeBaud = 57600;
+  safePacketLen = packet_len;
+  scanStep = 0;
+  linkStep = LINK_STEP_IDLE;
+  indexTarget = NULL;
+  shadowIndex = NULL;
+  invalidateShadow();
+  resetParser();
+}
 
 /**************************************************************************/
 /*!
-    @brief  Instantiates sensor with Hardware Serial
-    @param  hs Pointer to HardwareSerial object
-    @param  password 32-bit integer password (default is 0)
-
+    @brief  Initializes serial interface and baud rate. The sensor may still be
+   booting, handshake() waits for it
+    @param  baudrate Sensor's UART baud rate (usually 57600, 9600 or 115200)
 */
 /**************************************************************************/
-Fingerprint::Fingerprint(HardwareSerial *hs,
-                                           uint32_t password) {
-  thePassword = password;
-  theAddress = 0xFFFFFFFF;
-
-#if defined(__AVR__) || defined(ESP8266) || defined(FREEDOM_E300_HIFIVE1)
-  swSerial = NULL;
-#endif
-  hwSerial = hs;
-  mySerial = hwSerial;
+template <class Transport>
+void Fingerprint<Transport>::begin(uint32_t baudrate) {
+  switchTransport(baudrate);
+  safeBaud = baudrate;
 }
 
 /**************************************************************************/
 /*!
-    @brief  Instantiates sensor with a stream for Serial
-    @param  serial Pointer to a Stream object
-    @param  password 32-bit integer password (default is 0)
-
+    @brief  Verifies the sensors' access password (default password is
+   0x0000000). A good way to also check if the sensors is active and responding
+    @returns True if password is correct
 */
 /**************************************************************************/
-
-Fingerprint::Fingerprint(Stream *serial, uint32_t password) {
-
-  thePassword = password;
-  theAddress = 0xFFFFFFFF;
-
-  hwSerial = NULL;
-#if defined(__AVR__) || defined(ESP8266) || defined(FREEDOM_E300_HIFIVE1)
-  swSerial = NULL;
-#endif
-  mySerial = serial;
+template <class Transport>
+boolean Fingerprint<Transport>::verifyPassword(void) {
+  return checkPassword() == FINGERPRINT_OK;
 }
 
 /**************************************************************************/
 /*!
-    @brief  Initializes serial interface and baud rate
-    @param  baudrate Sensor's UART baud rate (usually 57600, 9600 or 115200)
+    @brief  Wait for the sensor to answer, in place of a fixed boot delay. See
+   handshakeLoop() for the scan
+    @param  budget Time to keep trying for, in milliseconds
+    @returns <code>FINGERPRINT_OK</code> if the sensor answered and accepted
+   the password
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> if it answered but
+   refused the password
+    @returns <code>FINGERPRINT_TIMEOUT</code> if no rate got an answer within
+   the budget
 */
 /**************************************************************************/
-void Fingerprint::begin(uint32_t baudrate) {
-  delay(1000); // one second delay to let the sensor 'boot up'
+template <class Transport>
+uint8_t Fingerprint<Transport>::handshake(uint16_t budget) {
+  uint32_t preferred = safeBaud;
+  uint32_t start = millis();
 
-  if (hwSerial)
-    hwSerial->begin(baudrate);
-#if defined(__AVR__) || defined(ESP8266) || defined(FREEDOM_E300_HIFIVE1)
-  if (swSerial)
-    swSerial->begin(baudrate);
-#endif
+  scanStep = 0;
+  do {
+    commandLoop();
+    uint8_t status = handshakeLoop();
+    if (status != FINGERPRINT_TIMEOUT)
+      return status;
+  } while (cmdState != FINGERPRINT_CMD_IDLE || (millis() - start) < budget);
+
+  switchTransport(preferred);
+  return FINGERPRINT_TIMEOUT;
 }
 
 /**************************************************************************/
 /*!
-    @brief  Verifies the sensors' access password (default password is
-   0x0000000). A good way to also check if the sensors is active and responding
-    @returns True if password is correct
+    @brief  Look for the sensor without blocking, one probe at a time. The
+   password is sent with a short timeout at the begin() rate, and between
+   those attempts at each of the other standard rates in turn, so a sensor left
+   at another rate is found while a booting one answers as soon as it is up.
+   A sensor found faster than the begin() rate, e.g. one negotiateLink() left
+   there before a power cycle, counts as a raised link that fallbackLink() can
+   still take back down. One found slower makes that rate the fallback. Call
+   it from the loop alongside commandLoop(), with no other command in flight
+    @returns <code>FINGERPRINT_TIMEOUT</code> while no rate has answered yet
+    @returns <code>FINGERPRINT_OK</code> if the sensor answered and accepted
+   the password
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> if it answered but
+   refused the password
 */
 /**************************************************************************/
-boolean Fingerprint::verifyPassword(void) {
-  return checkPassword() == FINGERPRINT_OK;
+template <class Transport>
+uint8_t Fingerprint<Transport>::handshakeLoop(void) {
+  if (cmdState == FINGERPRINT_CMD_IDLE) {
+    uint32_t baud = nextScanBaud();
+    if (baud != linkBaud)
+      switchTransport(baud);
+    probe();
+    return FINGERPRINT_TIMEOUT;
+  }
+  if (cmdState != FINGERPRINT_CMD_DONE)
+    return FINGERPRINT_TIMEOUT;
+
+  cmdState = FINGERPRINT_CMD_IDLE;
+  if (cmdStatus != FINGERPRINT_OK)
+    return FINGERPRINT_TIMEOUT;
+
+  scanStep = 0;
+  if (linkBaud < safeBaud)
+    safeBaud = linkBaud;
+  // a sensor found again may have restarted
+  invalidateShadow();
+  return (rxPacket.data[0] == FINGERPRINT_OK) ? FINGERPRINT_OK
+                                              : FINGERPRINT_PACKETRECIEVEERR;
 }
 
-uint8_t Fingerprint::checkPassword(void) {
+template <class Transport>
+uint8_t Fingerprint<Transport>::checkPassword(void) {
   GET_CMD_PACKET(FINGERPRINT_VERIFYPASSWORD, (uint8_t)(thePassword >> 24),
                  (uint8_t)(thePassword >> 16), (uint8_t)(thePassword >> 8),
                  (uint8_t)(thePassword & 0xFF));
@@ -156,33 +284,35 @@ uint8_t Fingerprint::checkPassword(void) {
 /*!
     @brief  Get the sensors parameters, fills in the member variables
     status_reg, system_id, capacity, security_level, device_addr, packet_len
-    and baud_rate
+    and baud_rate. Once read they are kept in step with writeRegister(), so
+    later calls are answered without asking the sensor
     @returns True if password is correct
 */
 /**************************************************************************/
-uint8_t Fingerprint::getParameters(void) {
-  GET_CMD_PACKET(FINGERPRINT_READSYSPARAM);
-
-  status_reg = ((uint16_t)packet.data[1] << 8) | packet.data[2];
-  system_id = ((uint16_t)packet.data[3] << 8) | packet.data[4];
-  capacity = ((uint16_t)packet.data[5] << 8) | packet.data[6];
-  security_level = ((uint16_t)packet.data[7] << 8) | packet.data[8];
-  device_addr = ((uint32_t)packet.data[9] << 24) |
-                ((uint32_t)packet.data[10] << 16) |
-                ((uint32_t)packet.data[11] << 8) | (uint32_t)packet.data[12];
-  packet_len = ((uint16_t)packet.data[13] << 8) | packet.data[14];
-  if (packet_len == 0) {
-    packet_len = 32;
-  } else if (packet_len == 1) {
-    packet_len = 64;
-  } else if (packet_len == 2) {
-    packet_len = 128;
-  } else if (packet_len == 3) {
-    packet_len = 256;
+template <class Transport>
+uint8_t Fingerprint<Transport>::getParameters(void) {
+  if (paramsValid) {
+    paramShadowHits++;
+    return FINGERPRINT_OK;
   }
-  baud_rate = (((uint16_t)packet.data[15] << 8) | packet.data[16]) * 9600;
 
-  return packet.data[0];
+  SEND_STATIC_CMD_PACKET(FINGERPRINT_READSYSPARAM);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Start reading the sensor parameters without waiting for the
+   sensor. The sensor is always asked, and the member variables filled in by
+   getParameters() are set once it answers. The result is reported through the
+   callback or commandResult()
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::getParametersAsync(
+    FingerprintCmdCallback callback) {
+  BEGIN_STATIC_CMD_PACKET(callback, FINGERPRINT_READSYSPARAM);
 }
 
 /**************************************************************************/
@@ -194,8 +324,9 @@ uint8_t Fingerprint::getParameters(void) {
     @returns <code>FINGERPRINT_IMAGEFAIL</code> on imaging error
 */
 /**************************************************************************/
-uint8_t Fingerprint::getImage(void) {
-  SEND_CMD_PACKET(FINGERPRINT_GETIMAGE);
+template <class Transport>
+uint8_t Fingerprint<Transport>::getImage(void) {
+  SEND_STATIC_CMD_PACKET(FINGERPRINT_GETIMAGE);
 }
 
 /**************************************************************************/
@@ -211,7 +342,13 @@ uint8_t Fingerprint::getImage(void) {
     @returns <code>FINGERPRINT_INVALIDIMAGE</code> on failure to identify
    fingerprint features
 */
-uint8_t Fingerprint::image2Tz(uint8_t slot) {
+template <class Transport>
+uint8_t Fingerprint<Transport>::image2Tz(uint8_t slot) {
+  if (slot == 1) {
+    SEND_STATIC_CMD_PACKET(FINGERPRINT_IMAGE2TZ, 1);
+  } else if (slot == 2) {
+    SEND_STATIC_CMD_PACKET(FINGERPRINT_IMAGE2TZ, 2);
+  }
   SEND_CMD_PACKET(FINGERPRINT_IMAGE2TZ, slot);
 }
 
@@ -223,38 +360,58 @@ uint8_t Fingerprint::image2Tz(uint8_t slot) {
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
     @returns <code>FINGERPRINT_ENROLLMISMATCH</code> on mismatch of fingerprints
 */
-uint8_t Fingerprint::createModel(void) {
-  SEND_CMD_PACKET(FINGERPRINT_REGMODEL);
+template <class Transport>
+uint8_t Fingerprint<Transport>::createModel(void) {
+  SEND_STATIC_CMD_PACKET(FINGERPRINT_REGMODEL);
 }
 
 /**************************************************************************/
 /*!
     @brief   Ask the sensor to store the calculated model for later matching
     @param   location The model location #
+    @param   slot The character buffer to store from, defaults to 1
     @returns <code>FINGERPRINT_OK</code> on success
     @returns <code>FINGERPRINT_BADLOCATION</code> if the location is invalid
     @returns <code>FINGERPRINT_FLASHERR</code> if the model couldn't be written
    to flash memory
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
-uint8_t Fingerprint::storeModel(uint16_t location) {
-  SEND_CMD_PACKET(FINGERPRINT_STORE, 0x01, (uint8_t)(location >> 8),
+template <class Transport>
+uint8_t Fingerprint<Transport>::storeModel(uint16_t location, uint8_t slot) {
+  SEND_CMD_PACKET(FINGERPRINT_STORE, slot, (uint8_t)(location >> 8),
                   (uint8_t)(location & 0xFF));
 }
 
 /**************************************************************************/
 /*!
-    @brief   Ask the sensor to load a fingerprint model from flash into buffer 1
+    @brief   Ask the sensor to load a fingerprint model from flash into a
+   character buffer
     @param   location The model location #
+    @param   slot The character buffer to load into, defaults to 1
     @returns <code>FINGERPRINT_OK</code> on success
     @returns <code>FINGERPRINT_BADLOCATION</code> if the location is invalid
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
-uint8_t Fingerprint::loadModel(uint16_t location) {
-  SEND_CMD_PACKET(FINGERPRINT_LOAD, 0x01, (uint8_t)(location >> 8),
+template <class Transport>
+uint8_t Fingerprint<Transport>::loadModel(uint16_t location, uint8_t slot) {
+  SEND_CMD_PACKET(FINGERPRINT_LOAD, slot, (uint8_t)(location >> 8),
                   (uint8_t)(location & 0xFF));
 }
 
+/**************************************************************************/
+/*!
+    @brief   Ask the sensor to compare the features in slot 1 against those in
+   slot 2, a 1:1 match. The matching score is stored in <b>confidence</b>
+    @returns <code>FINGERPRINT_OK</code> if the fingerprints match
+    @returns <code>FINGERPRINT_NOMATCH</code> if they don't
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::fingerMatch(void) {
+  SEND_STATIC_CMD_PACKET(FINGERPRINT_MATCH);
+}
+
 /**************************************************************************/
 /*!
     @brief   Ask the sensor to transfer 256-byte fingerprint template from the
@@ -262,10 +419,69 @@ uint8_t Fingerprint::loadModel(uint16_t location) {
     @returns <code>FINGERPRINT_OK</code> on success
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
-uint8_t Fingerprint::getModel(void) {
+template <class Transport>
+uint8_t Fingerprint<Transport>::getModel(void) {
   SEND_CMD_PACKET(FINGERPRINT_UPLOAD, 0x01);
 }
 
+/**************************************************************************/
+/*!
+    @brief   Stream a character buffer out of the sensor. The template arrives
+   as a train of data packets, each handed to the sink in chunks of up to 64
+   bytes as it is received, so it never has to fit in RAM
+    @param   slot The character buffer to upload
+    @param   sink Called with each chunk of template data
+    @returns <code>FINGERPRINT_OK</code> once the last data packet was received
+   intact
+    @returns <code>FINGERPRINT_UPLOADFEATUREFAIL</code> if the sensor refused
+    @returns <code>FINGERPRINT_BADPACKET</code> if a packet was corrupted, the
+   data already handed over is then unusable
+    @returns <code>FINGERPRINT_TIMEOUT</code> if the acknowledge or the data
+   stopped coming
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::uploadModel(uint8_t slot,
+                                            FingerprintDataSink sink) {
+  while (cmdState == FINGERPRINT_CMD_PENDING)
+    commandLoop();
+
+  uploadModelAsync(slot, sink);
+  uint8_t status = awaitCommand();
+  if (status != FINGERPRINT_OK)
+    return status;
+  return cmdResult;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Stream a template from the caller into a character buffer of the
+   sensor, <b>packet_len</b> bytes per data packet. The data is pulled from the
+   source while the packets are written, so it never has to fit in RAM
+    @param   slot The character buffer to download into
+    @param   source Called for each piece of template data
+    @param   length Size of the template in bytes
+    @returns <code>FINGERPRINT_OK</code> once all the data was sent
+    @returns <code>FINGERPRINT_PACKETRESPONSEFAIL</code> if the sensor refused
+    @returns <code>FINGERPRINT_BADPACKET</code> if the source failed, or had
+   nothing for the command timeout
+    @returns <code>FINGERPRINT_TIMEOUT</code> if the acknowledge didn't come
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::downloadModel(uint8_t slot,
+                                              FingerprintDataSource source,
+                                              uint16_t length) {
+  while (cmdState == FINGERPRINT_CMD_PENDING)
+    commandLoop();
+
+  downloadModelAsync(slot, source, length);
+  uint8_t status = awaitCommand();
+  if (status != FINGERPRINT_OK)
+    return status;
+  return cmdResult;
+}
+
 /**************************************************************************/
 /*!
     @brief   Ask the sensor to delete a model in memory
@@ -276,7 +492,8 @@ uint8_t Fingerprint::getModel(void) {
    to flash memory
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
-uint8_t Fingerprint::deleteModel(uint16_t location) {
+template <class Transport>
+uint8_t Fingerprint<Transport>::deleteModel(uint16_t location) {
   SEND_CMD_PACKET(FINGERPRINT_DELETE, (uint8_t)(location >> 8),
                   (uint8_t)(location & 0xFF), 0x00, 0x01);
 }
@@ -290,8 +507,9 @@ uint8_t Fingerprint::deleteModel(uint16_t location) {
    to flash memory
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
-uint8_t Fingerprint::emptyDatabase(void) {
-  SEND_CMD_PACKET(FINGERPRINT_EMPTY);
+template <class Transport>
+uint8_t Fingerprint<Transport>::emptyDatabase(void) {
+  SEND_STATIC_CMD_PACKET(FINGERPRINT_EMPTY);
 }
 
 /**************************************************************************/
@@ -304,21 +522,10 @@ uint8_t Fingerprint::emptyDatabase(void) {
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
 /**************************************************************************/
-uint8_t Fingerprint::fingerFastSearch(void) {
-  // high speed search of slot #1 starting at page 0x0000 and page #0x00A3
-  GET_CMD_PACKET(FINGERPRINT_HISPEEDSEARCH, 0x01, 0x00, 0x00, 0x00, 0xA3);
-  fingerID = 0xFFFF;
-  confidence = 0xFFFF;
-
-  fingerID = packet.data[1];
-  fingerID <<= 8;
-  fingerID |= packet.data[2];
-
-  confidence = packet.data[3];
-  confidence <<= 8;
-  confidence |= packet.data[4];
-
-  return packet.data[0];
+template <class Transport>
+uint8_t Fingerprint<Transport>::fingerFastSearch(void) {
+  // high speed search of slot #1 starting at page 0x0000 thru the capacity
+  return fingerFastSearch(1, 0, capacity);
 }
 
 /**************************************************************************/
@@ -328,11 +535,12 @@ uint8_t Fingerprint::fingerFastSearch(void) {
     @returns <code>FINGERPRINT_OK</code> on success
 */
 /**************************************************************************/
-uint8_t Fingerprint::LEDcontrol(bool on) {
+template <class Transport>
+uint8_t Fingerprint<Transport>::LEDcontrol(bool on) {
   if (on) {
-    SEND_CMD_PACKET(FINGERPRINT_LEDON);
+    SEND_STATIC_CMD_PACKET(FINGERPRINT_LEDON);
   } else {
-    SEND_CMD_PACKET(FINGERPRINT_LEDOFF);
+    SEND_STATIC_CMD_PACKET(FINGERPRINT_LEDOFF);
   }
 }
 
@@ -343,17 +551,50 @@ uint8_t Fingerprint::LEDcontrol(bool on) {
     @param control The control code (e.g. breathing, full on)
     @param speed How fast to go through the breathing/blinking cycles
     @param coloridx What color to light the indicator
-    @param count How many repeats of blinks/breathing cycles
-    @returns <code>FINGERPRINT_OK</code> on fingerprint match success
+    @param count How many repeats of blinks/breathing cycles, 0 to run the
+   effect until told otherwise
+    @returns <code>FINGERPRINT_OK</code> on fingerprint match success, or
+   straight away if the same endless effect is already running
     @returns <code>FINGERPRINT_NOTFOUND</code> no match made
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
 /**************************************************************************/
-uint8_t Fingerprint::LEDcontrol(uint8_t control, uint8_t speed,
+template <class Transport>
+uint8_t Fingerprint<Transport>::LEDcontrol(uint8_t control, uint8_t speed,
                                          uint8_t coloridx, uint8_t count) {
+  if (ledShadowed(control, speed, coloridx, count))
+    return FINGERPRINT_OK;
+
   SEND_CMD_PACKET(FINGERPRINT_AURALEDCONFIG, control, speed, coloridx, count);
 }
 
+/**************************************************************************/
+/*!
+    @brief   Start an Aura LED command without waiting for the sensor. The
+   result of LEDcontrol() is reported through the callback or commandResult().
+   If the same endless effect is already running nothing is sent, the engine
+   stays idle and the callback isn't called
+    @param control The control code (e.g. breathing, full on)
+    @param speed How fast to go through the breathing/blinking cycles
+    @param coloridx What color to light the indicator
+    @param count How many repeats of blinks/breathing cycles, 0 to run the
+   effect until told otherwise
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent or wasn't needed, false if another
+   one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::LEDcontrolAsync(uint8_t control, uint8_t speed,
+                                             uint8_t coloridx, uint8_t count,
+                                             FingerprintCmdCallback callback) {
+  if (ledShadowed(control, speed, coloridx, count))
+    return true;
+
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_AURALEDCONFIG, control, speed,
+                   coloridx, count);
+}
+
 /**************************************************************************/
 /*!
     @brief   Ask the sensor to search the current slot fingerprint features to
@@ -365,206 +606,1734 @@ uint8_t Fingerprint::LEDcontrol(uint8_t control, uint8_t speed,
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
 /**************************************************************************/
-uint8_t Fingerprint::fingerSearch(uint8_t slot) {
+template <class Transport>
+uint8_t Fingerprint<Transport>::fingerSearch(uint8_t slot) {
   // search of slot starting thru the capacity
-  GET_CMD_PACKET(FINGERPRINT_SEARCH, slot, 0x00, 0x00, capacity >> 8,
-                 capacity & 0xFF);
-
-  fingerID = 0xFFFF;
-  confidence = 0xFFFF;
-
-  fingerID = packet.data[1];
-  fingerID <<= 8;
-  fingerID |= packet.data[2];
+  SEND_CMD_PACKET(FINGERPRINT_SEARCH, slot, 0x00, 0x00,
+                  (uint8_t)(capacity >> 8), (uint8_t)(capacity & 0xFF));
+}
 
-  confidence = packet.data[3];
-  confidence <<= 8;
-  confidence |= packet.data[4];
+/**************************************************************************/
+/*!
+    @brief   Ask the sensor to search a page range of the library for the
+   current slot fingerprint features. The matching location is stored in
+   <b>fingerID</b> and the matching confidence in <b>confidence</b>
+    @param   slot The slot to use for the print search
+    @param   startPage The first library page to search
+    @param   pageCount How many pages to search from startPage
+    @returns <code>FINGERPRINT_OK</code> on fingerprint match success
+    @returns <code>FINGERPRINT_NOTFOUND</code> no match made
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::fingerSearch(uint8_t slot, uint16_t startPage,
+                                             uint16_t pageCount) {
+  SEND_CMD_PACKET(FINGERPRINT_SEARCH, slot, (uint8_t)(startPage >> 8),
+                  (uint8_t)(startPage & 0xFF), (uint8_t)(pageCount >> 8),
+                  (uint8_t)(pageCount & 0xFF));
+}
 
-  return packet.data[0];
+/**************************************************************************/
+/*!
+    @brief   Ask the sensor for a high speed search of a page range of the
+   library. The matching location is stored in <b>fingerID</b> and the
+   matching confidence in <b>confidence</b>
+    @param   slot The slot to use for the print search
+    @param   startPage The first library page to search
+    @param   pageCount How many pages to search from startPage
+    @returns <code>FINGERPRINT_OK</code> on fingerprint match success
+    @returns <code>FINGERPRINT_NOTFOUND</code> no match made
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::fingerFastSearch(uint8_t slot,
+                                                 uint16_t startPage,
+                                                 uint16_t pageCount) {
+  SEND_CMD_PACKET(FINGERPRINT_HISPEEDSEARCH, slot, (uint8_t)(startPage >> 8),
+                  (uint8_t)(startPage & 0xFF), (uint8_t)(pageCount >> 8),
+                  (uint8_t)(pageCount & 0xFF));
 }
 
 /**************************************************************************/
 /*!
     @brief   Ask the sensor for the number of templates stored in memory. The
-   number is stored in <b>templateCount</b> on success.
+   number is stored in <b>templateCount</b> on success. An attached index that
+   covers the whole library answers without asking the sensor
     @returns <code>FINGERPRINT_OK</code> on success
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
 /**************************************************************************/
-uint8_t Fingerprint::getTemplateCount(void) {
-  GET_CMD_PACKET(FINGERPRINT_TEMPLATECOUNT);
+template <class Transport>
+uint8_t Fingerprint<Transport>::getTemplateCount(void) {
+  if (shadowIndex != NULL && shadowIndex->capacity() == capacity) {
+    templateCount = shadowIndex->count();
+    countShadowHits++;
+    return FINGERPRINT_OK;
+  }
 
-  templateCount = packet.data[1];
-  templateCount <<= 8;
-  templateCount |= packet.data[2];
+  SEND_STATIC_CMD_PACKET(FINGERPRINT_TEMPLATECOUNT);
+}
 
-  return packet.data[0];
+/**************************************************************************/
+/*!
+    @brief   Start reading the template count without waiting for the sensor.
+   The sensor is always asked, on completion the count is in
+   <b>templateCount</b>
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::getTemplateCountAsync(
+    FingerprintCmdCallback callback) {
+  BEGIN_STATIC_CMD_PACKET(callback, FINGERPRINT_TEMPLATECOUNT);
 }
 
 /**************************************************************************/
 /*!
-    @brief   Set the password on the sensor (future communication will require
-   password verification so don't forget it!!!)
-    @param   password 32-bit password code
+    @brief   Ask the sensor for one page of its index table, the occupancy
+   bitmap of the template library. The FINGERPRINT_INDEX_PAGE_BYTES bytes of
+   the table follow the confirmation code in <b>rxPacket</b> on success
+    @param   page The index table page, each covers 256 locations
     @returns <code>FINGERPRINT_OK</code> on success
     @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
 */
 /**************************************************************************/
-uint8_t Fingerprint::setPassword(uint32_t password) {
-  SEND_CMD_PACKET(FINGERPRINT_SETPASSWORD, (password >> 24), (password >> 16),
-                  (password >> 8), password);
+template <class Transport>
+uint8_t Fingerprint<Transport>::readIndexTable(uint8_t page) {
+  GET_CMD_PACKET(FINGERPRINT_READINDEXTABLE, page);
+  if (packet.data[0] == FINGERPRINT_OK &&
+      packet.length < FINGERPRINT_INDEX_PAGE_BYTES + 1)
+    return FINGERPRINT_PACKETRECIEVEERR;
+  return packet.data[0];
 }
 
 /**************************************************************************/
 /*!
-    @brief   Helper function to process a packet and send it over UART to the
-   sensor
-    @param   packet A structure containing the bytes to transmit
+    @brief   Start reading one page of the index table without waiting for
+   the sensor. The result of readIndexTable() is reported through the callback
+   or commandResult(), the table follows the confirmation code in
+   <b>rxPacket</b>
+    @param   page The index table page, each covers 256 locations
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
 */
 /**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::readIndexTableAsync(
+    uint8_t page, FingerprintCmdCallback callback) {
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_READINDEXTABLE, page);
+}
 
-void Fingerprint::writeStructuredPacket(
-    const Fingerprint_Packet &packet) {
-
-  mySerial->write((uint8_t)(packet.start_code >> 8));
-  mySerial->write((uint8_t)(packet.start_code & 0xFF));
-  mySerial->write(packet.address[0]);
-  mySerial->write(packet.address[1]);
-  mySerial->write(packet.address[2]);
-  mySerial->write(packet.address[3]);
-  mySerial->write(packet.type);
+/**************************************************************************/
+/*!
+    @brief   Read the sensor index table into an occupancy index, one page per
+   256 locations of <b>capacity</b>, and attach it. Call getParameters() first
+   so the real capacity of the sensor is known
+    @param   index The index to fill in, reset to the sensor capacity first
+    @returns <code>FINGERPRINT_OK</code> on success
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::loadIndex(FingerprintIndex *index) {
+  while (cmdState == FINGERPRINT_CMD_PENDING)
+    commandLoop();
 
-  uint16_t wire_length = packet.length + 2;
-  mySerial->write((uint8_t)(wire_length >> 8));
-  mySerial->write((uint8_t)(wire_length & 0xFF));
+  if (!beginLoadIndex(index))
+    return FINGERPRINT_PACKETRECIEVEERR;
+  uint8_t status;
+  do {
+    commandLoop();
+    status = loadIndexLoop();
+  } while (status == FINGERPRINT_PENDING);
+  return status;
+}
 
-#ifdef FINGERPRINT_DEBUG
-  Serial.print("-> 0x");
-  Serial.print((uint8_t)(packet.start_code >> 8), HEX);
-  Serial.print(", 0x");
-  Serial.print((uint8_t)(packet.start_code & 0xFF), HEX);
-  Serial.print(", 0x");
-  Serial.print(packet.address[0], HEX);
-  Serial.print(", 0x");
-  Serial.print(packet.address[1], HEX);
-  Serial.print(", 0x");
-  Serial.print(packet.address[2], HEX);
-  Serial.print(", 0x");
-  Serial.print(packet.address[3], HEX);
-  Serial.print(", 0x");
-  Serial.print(packet.type, HEX);
-  Serial.print(", 0x");
-  Serial.print((uint8_t)(wire_length >> 8), HEX);
-  Serial.print(", 0x");
-  Serial.print((uint8_t)(wire_length & 0xFF), HEX);
-#endif
+/**************************************************************************/
+/*!
+    @brief   Start reading the sensor index table into an occupancy index
+   without waiting for the sensor, one page per call of loadIndexLoop(). The
+   index is detached and reset to the sensor capacity first
+    @param   index The index to fill in
+    @returns True if the first page was asked for, false if another command
+   is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::beginLoadIndex(FingerprintIndex *index) {
+  if (cmdState == FINGERPRINT_CMD_PENDING)
+    return false;
 
-  uint16_t sum = ((wire_length) >> 8) + ((wire_length)&0xFF) + packet.type;
-  for (uint8_t i = 0; i < packet.length; i++) {
-    mySerial->write(packet.data[i]);
-    sum += packet.data[i];
-#ifdef FINGERPRINT_DEBUG
-    Serial.print(", 0x");
-    Serial.print(packet.data[i], HEX);
-#endif
-  }
+  if (shadowIndex == index)
+    shadowIndex = NULL;
+  index->begin(capacity);
+  indexTarget = index;
+  indexPage = 0;
+  // pages past what the index can track would be dropped anyway
+  indexPages = (index->capacity() + 255) / 256;
+  return readIndexTableAsync(0);
+}
 
-  mySerial->write((uint8_t)(sum >> 8));
-  mySerial->write((uint8_t)(sum & 0xFF));
+/**************************************************************************/
+/*!
+    @brief   Step the index load started by beginLoadIndex(). Call it from
+   the loop alongside commandLoop(), each page read is followed by the next
+   until the index is complete and attached
+    @returns <code>FINGERPRINT_PENDING</code> while pages are still being read
+    @returns <code>FINGERPRINT_OK</code> once the index is attached
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::loadIndexLoop(void) {
+  if (cmdState == FINGERPRINT_CMD_PENDING)
+    return FINGERPRINT_PENDING;
+  if (indexTarget == NULL)
+    return FINGERPRINT_PACKETRECIEVEERR;
 
-#ifdef FINGERPRINT_DEBUG
-  Serial.print(", 0x");
-  Serial.print((uint8_t)(sum >> 8), HEX);
-  Serial.print(", 0x");
-  Serial.println((uint8_t)(sum & 0xFF), HEX);
-#endif
+  uint8_t status = commandResult();
+  if (status == FINGERPRINT_OK &&
+      rxPacket.length < FINGERPRINT_INDEX_PAGE_BYTES + 1)
+    status = FINGERPRINT_PACKETRECIEVEERR;
+  if (status != FINGERPRINT_OK) {
+    indexTarget = NULL;
+    return status;
+  }
 
-  return;
+  indexTarget->loadPage(indexPage, rxPacket.data + 1);
+  if (++indexPage < indexPages) {
+    readIndexTableAsync(indexPage);
+    return FINGERPRINT_PENDING;
+  }
+  attachIndex(indexTarget);
+  indexTarget = NULL;
+  return FINGERPRINT_OK;
 }
 
 /**************************************************************************/
 /*!
-    @brief   Helper function to receive data over UART from the sensor and
-   process it into a packet
-    @param   packet A structure containing the bytes received
-    @param   timeout how many milliseconds we're willing to wait
-    @returns <code>FINGERPRINT_OK</code> on success
-    @returns <code>FINGERPRINT_TIMEOUT</code> or
-   <code>FINGERPRINT_BADPACKET</code> on failure
+    @brief   Keep an occupancy index in step with the library. Every store,
+   delete and empty the sensor acknowledges is applied to it, and
+   getTemplateCount() is answered from it
+    @param   index The index, holding the current occupancy, NULL to detach
 */
 /**************************************************************************/
-uint8_t
-Fingerprint::getStructuredPacket(Fingerprint_Packet *packet,
-                                          uint16_t timeout) {
-  uint8_t byte;
-  uint16_t idx = 0, timer = 0;
-
-#ifdef FINGERPRINT_DEBUG
-  Serial.print("<- ");
-#endif
+template <class Transport>
+void Fingerprint<Transport>::attachIndex(FingerprintIndex *index) {
+  shadowIndex = index;
+}
 
-  while (true) {
-    while (!mySerial->available()) {
-      delay(1);
-      timer++;
-      if (timer >= timeout) {
-#ifdef FINGERPRINT_DEBUG
-        Serial.println("Timed out");
-#endif
-        return FINGERPRINT_TIMEOUT;
-      }
-    }
-    byte = mySerial->read();
-#ifdef FINGERPRINT_DEBUG
-    Serial.print("0x");
-    Serial.print(byte, HEX);
-    Serial.print(", ");
-#endif
-    switch (idx) {
-    case 0:
-      if (byte != (FINGERPRINT_STARTCODE >> 8))
-        continue;
-      packet->start_code = (uint16_t)byte << 8;
-      break;
-    case 1:
-      packet->start_code |= byte;
-      if (packet->start_code != FINGERPRINT_STARTCODE)
-        return FINGERPRINT_BADPACKET;
-      break;
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-      packet->address[idx - 2] = byte;
-      break;
-    case 6:
-      packet->type = byte;
-      break;
-    case 7:
-      packet->length = (uint16_t)byte << 8;
-      break;
-    case 8:
-      packet->length |= byte;
-      break;
-    default:
-      packet->data[idx - 9] = byte;
-      if ((idx - 8) == packet->length) {
-#ifdef FINGERPRINT_DEBUG
-        Serial.println(" OK ");
-#endif
-        return FINGERPRINT_OK;
-      }
-      break;
-    }
-    idx++;
-  }
-  // Shouldn't get here so...
-  return FINGERPRINT_BADPACKET;
+/**************************************************************************/
+/*!
+    @brief   Forget the LED setting and parameters held for the sensor, for
+   when it may have restarted. The library occupancy lives in flash and is
+   kept
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::invalidateShadow(void) {
+  ledShadowValid = false;
+  paramsValid = false;
 }
 
-void Fingerprint::attachTouchCallback(void (*callback)(FingerTouchState_t state))
-{
-  swSerial->attachTouchCallback(callback);
+/**************************************************************************/
+/*!
+    @brief   Set the password on the sensor (future communication will require
+   password verification so don't forget it!!!)
+    @param   password 32-bit password code
+    @returns <code>FINGERPRINT_OK</code> on success
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::setPassword(uint32_t password) {
+  SEND_CMD_PACKET(FINGERPRINT_SETPASSWORD, (password >> 24), (password >> 16),
+                  (password >> 8), password);
 }
 
+/**************************************************************************/
+/*!
+    @brief   Write to a sensor system parameter (SetSysPara). Writing the
+   packet length or security level the parameters already hold is skipped.
+   The baud rate is always written, it is also used to talk a sensor back
+   whose real rate isn't known
+    @param   regAdd Register address, e.g. <code>FINGERPRINT_BAUD_REG_ADDR</code>
+    @param   value Value to write to the register
+    @returns <code>FINGERPRINT_OK</code> on success
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+    @returns <code>FINGERPRINT_INVALIDREG</code> if the register doesn't exist
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::writeRegister(uint8_t regAdd, uint8_t value) {
+  if (registerShadowed(regAdd, value))
+    return FINGERPRINT_OK;
+
+  SEND_CMD_PACKET(FINGERPRINT_WRITE_REG, regAdd, value);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Change the UART baud rate of the sensor. The transport is left
+   alone, see negotiateLink()
+    @param   baudrate <code>FINGERPRINT_BAUDRATE_9600</code> up to
+   <code>FINGERPRINT_BAUDRATE_115200</code>, the baud rate over 9600
+    @returns <code>FINGERPRINT_OK</code> on success
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::setBaudRate(uint8_t baudrate) {
+  return writeRegister(FINGERPRINT_BAUD_REG_ADDR, baudrate);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Change the data packet length of the sensor, and
+   <b>packet_len</b> to match
+    @param   size <code>FINGERPRINT_PACKET_SIZE_32</code> up to
+   <code>FINGERPRINT_PACKET_SIZE_256</code>
+    @returns <code>FINGERPRINT_OK</code> on success
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::setPacketSize(uint8_t size) {
+  return writeRegister(FINGERPRINT_PACKET_REG_ADDR, size);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Raise the link to a faster baud rate and a longer data packet.
+   The sensor is switched first, then the transport, and the new rate has to
+   pass <code>FINGERPRINT_LINK_PROBES</code> handshakes without a single bad
+   or resynced packet. Only then is the packet length written, both settings
+   live in the sensor's flash. Otherwise both ends go back to the current
+   rate, which stays the one fallbackLink() returns to
+    @param   baud The baud rate to try, a multiple of 9600 up to 115200
+    @param   packetSize <code>FINGERPRINT_PACKET_SIZE_32</code> up to
+   <code>FINGERPRINT_PACKET_SIZE_256</code>
+    @returns <code>FINGERPRINT_OK</code> if the link runs at the new rate with
+   the new packet length
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> if the new rate didn't
+   hold up and the link was put back, or the packet length write wasn't
+   acknowledged. The rate is kept then, and <b>packet_len</b> is read back
+   from the sensor
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::negotiateLink(uint32_t baud,
+                                              uint8_t packetSize) {
+  while (cmdState == FINGERPRINT_CMD_PENDING)
+    commandLoop();
+
+  if (!beginNegotiateLink(baud, packetSize))
+    return FINGERPRINT_PACKETRECIEVEERR;
+  uint8_t status;
+  do {
+    commandLoop();
+    status = negotiateLinkLoop();
+  } while (status == FINGERPRINT_PENDING);
+  return status;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start raising the link without waiting for the sensor, one
+   command per call of negotiateLinkLoop(). See negotiateLink() for the steps
+    @param   baud The baud rate to try, a multiple of 9600 up to 115200
+    @param   packetSize <code>FINGERPRINT_PACKET_SIZE_32</code> up to
+   <code>FINGERPRINT_PACKET_SIZE_256</code>
+    @returns True if the negotiation started, false if another command is in
+   flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::beginNegotiateLink(uint32_t baud,
+                                                uint8_t packetSize) {
+  if (cmdState == FINGERPRINT_CMD_PENDING)
+    return false;
+
+  // a write the shadow answers leaves the engine as it is, so it starts idle
+  cmdState = FINGERPRINT_CMD_IDLE;
+  linkFrom = linkBaud;
+  linkTarget = baud;
+  linkPacketSize = packetSize;
+  if (baud == linkBaud) {
+    // data packets longer than the buffer are streamed, so any size will do
+    linkStep = LINK_STEP_PACKET;
+    return writeRegisterAsync(FINGERPRINT_PACKET_REG_ADDR, packetSize);
+  }
+  linkStep = LINK_STEP_BAUD;
+  return writeRegisterAsync(FINGERPRINT_BAUD_REG_ADDR, baud / 9600);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Step the link negotiation started by beginNegotiateLink(). Call
+   it from the loop alongside commandLoop(), each acknowledge is followed by
+   the next command until the link runs at the new rate or was put back
+    @returns <code>FINGERPRINT_PENDING</code> while the negotiation is still
+   in progress
+    @returns <code>FINGERPRINT_OK</code> if the link runs at the new rate
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> if the new rate didn't
+   hold up and the link was put back, or the packet length write failed
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::negotiateLinkLoop(void) {
+  if (cmdState == FINGERPRINT_CMD_PENDING)
+    return FINGERPRINT_PENDING;
+  uint8_t result = (cmdState == FINGERPRINT_CMD_DONE) ? commandResult()
+                                                       : FINGERPRINT_OK;
+
+  switch (linkStep) {
+  case LINK_STEP_BAUD:
+    if (result != FINGERPRINT_OK)
+      break;
+    switchTransport(linkTarget);
+    // a resend hides a lost acknowledge, which counts against the link too
+    linkErrors = rxErrors() + cmdResends;
+    linkProbes = 0;
+    linkStep = LINK_STEP_PROBE;
+    verifyPasswordAsync();
+    return FINGERPRINT_PENDING;
+  case LINK_STEP_PROBE:
+    if (result == FINGERPRINT_OK && ++linkProbes < FINGERPRINT_LINK_PROBES) {
+      verifyPasswordAsync();
+      return FINGERPRINT_PENDING;
+    }
+    if (result == FINGERPRINT_OK &&
+        (uint16_t)(rxErrors() + cmdResends) == linkErrors) {
+      safeBaud = linkFrom;
+      safePacketLen = packet_len;
+      linkStep = LINK_STEP_PACKET;
+      writeRegisterAsync(FINGERPRINT_PACKET_REG_ADDR, linkPacketSize);
+      return FINGERPRINT_PENDING;
+    }
+    // the sensor either switched and garbles at the new rate, or only applies
+    // the change after a restart; tell it at both rates so it stays put
+    linkStep = LINK_STEP_UNDO_NEW;
+    writeRegisterAsync(FINGERPRINT_BAUD_REG_ADDR, linkFrom / 9600);
+    return FINGERPRINT_PENDING;
+  case LINK_STEP_UNDO_NEW:
+    switchTransport(linkFrom);
+    linkStep = LINK_STEP_UNDO_OLD;
+    writeRegisterAsync(FINGERPRINT_BAUD_REG_ADDR, linkFrom / 9600);
+    return FINGERPRINT_PENDING;
+  case LINK_STEP_PACKET:
+  case LINK_STEP_FALL_PACKET:
+    if (result == FINGERPRINT_OK) {
+      linkStep = LINK_STEP_IDLE;
+      return FINGERPRINT_OK;
+    }
+    // WRITE_REG isn't resent, so a lost acknowledge leaves it unknown whether
+    // the sensor took the new length; ask it rather than guess
+    linkStep = LINK_STEP_PARAMS;
+    getParametersAsync();
+    return FINGERPRINT_PENDING;
+  case LINK_STEP_PARAMS:
+    if (result != FINGERPRINT_OK)
+      paramsValid = false;
+    break;
+  case LINK_STEP_FALL_BAUD:
+    // the degraded link may have lost the acknowledge, the handshake tells
+    switchTransport(safeBaud);
+    linkStep = LINK_STEP_FALL_PROBE;
+    verifyPasswordAsync();
+    return FINGERPRINT_PENDING;
+  case LINK_STEP_FALL_PROBE: {
+    if (result != FINGERPRINT_OK)
+      break;
+    uint8_t size = FINGERPRINT_PACKET_SIZE_32;
+    while ((32U << size) < safePacketLen && size < FINGERPRINT_PACKET_SIZE_256)
+      size++;
+    linkStep = LINK_STEP_FALL_PACKET;
+    writeRegisterAsync(FINGERPRINT_PACKET_REG_ADDR, size);
+    return FINGERPRINT_PENDING;
+  }
+  default:
+    break;
+  }
+  linkStep = LINK_STEP_IDLE;
+  return FINGERPRINT_PACKETRECIEVEERR;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Drop a raised link back to the rate it was negotiated up from,
+   for when the faster link starts showing framing errors. The packet length
+   the link had at that rate is restored too
+    @returns <code>FINGERPRINT_OK</code> if the sensor answers at the slower
+   rate
+    @returns <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::fallbackLink(void) {
+  while (cmdState == FINGERPRINT_CMD_PENDING)
+    commandLoop();
+
+  if (!linkRaised())
+    return FINGERPRINT_OK;
+  if (!beginFallbackLink())
+    return FINGERPRINT_PACKETRECIEVEERR;
+  uint8_t status;
+  do {
+    commandLoop();
+    status = fallbackLinkLoop();
+  } while (status == FINGERPRINT_PENDING);
+  return status;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start dropping a raised link back without waiting for the
+   sensor, one command per call of fallbackLinkLoop(). See fallbackLink()
+    @returns True if the fallback started, false if another command is in
+   flight or the link isn't raised
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::beginFallbackLink(void) {
+  if (cmdState == FINGERPRINT_CMD_PENDING || !linkRaised())
+    return false;
+
+  cmdState = FINGERPRINT_CMD_IDLE;
+  linkStep = LINK_STEP_FALL_BAUD;
+  // a degraded link may still carry this short command
+  return writeRegisterAsync(FINGERPRINT_BAUD_REG_ADDR, safeBaud / 9600);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start a password check without waiting for the sensor, a cheap
+   command to see that it still answers. The result of verifyPassword() is
+   reported through the callback or commandResult()
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::verifyPasswordAsync(
+    FingerprintCmdCallback callback) {
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_VERIFYPASSWORD,
+                   (uint8_t)(thePassword >> 24), (uint8_t)(thePassword >> 16),
+                   (uint8_t)(thePassword >> 8), (uint8_t)(thePassword & 0xFF));
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start an image capture without waiting for the sensor. The result
+   of getImage() is reported through the callback or commandResult()
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::getImageAsync(FingerprintCmdCallback callback) {
+  BEGIN_STATIC_CMD_PACKET(callback, FINGERPRINT_GETIMAGE);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start an image to feature template conversion without waiting for
+   the sensor. The result of image2Tz() is reported through the callback or
+   commandResult()
+    @param   slot Location to place feature template
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::image2TzAsync(uint8_t slot,
+                                FingerprintCmdCallback callback) {
+  if (slot == 1) {
+    BEGIN_STATIC_CMD_PACKET(callback, FINGERPRINT_IMAGE2TZ, 1);
+  } else if (slot == 2) {
+    BEGIN_STATIC_CMD_PACKET(callback, FINGERPRINT_IMAGE2TZ, 2);
+  }
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_IMAGE2TZ, slot);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start combining the feature templates of both character buffers
+   into a model without waiting for the sensor. The result of createModel() is
+   reported through the callback or commandResult()
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::createModelAsync(FingerprintCmdCallback callback) {
+  BEGIN_STATIC_CMD_PACKET(callback, FINGERPRINT_REGMODEL);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start loading a fingerprint model into a character buffer without
+   waiting for the sensor. The result of loadModel() is reported through the
+   callback or commandResult()
+    @param   location The model location #
+    @param   slot The character buffer to load into, defaults to 1
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::loadModelAsync(uint16_t location, uint8_t slot,
+                                            FingerprintCmdCallback callback) {
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_LOAD, slot, (uint8_t)(location >> 8),
+                   (uint8_t)(location & 0xFF));
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start storing a character buffer into the library without waiting
+   for the sensor. The result of storeModel() is reported through the callback
+   or commandResult()
+    @param   location The model location #
+    @param   slot The character buffer to store from, defaults to 1
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::storeModelAsync(uint16_t location, uint8_t slot,
+                                             FingerprintCmdCallback callback) {
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_STORE, slot,
+                   (uint8_t)(location >> 8), (uint8_t)(location & 0xFF));
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start deleting a model from the library without waiting for the
+   sensor. The result of deleteModel() is reported through the callback or
+   commandResult()
+    @param   location The model location #
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::deleteModelAsync(uint16_t location,
+                                              FingerprintCmdCallback callback) {
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_DELETE, (uint8_t)(location >> 8),
+                   (uint8_t)(location & 0xFF), 0x00, 0x01);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start streaming a character buffer out of the sensor without
+   waiting for it. commandLoop() hands the data packets to the sink as they
+   arrive, at the pace of the main loop, and the command completes once the
+   last one was received intact. The result of uploadModel() is reported
+   through the callback or commandResult()
+    @param   slot The character buffer to upload
+    @param   sink Called with each chunk of template data
+    @param   callback Called when the upload completes, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::uploadModelAsync(uint8_t slot,
+                                              FingerprintDataSink sink,
+                                              FingerprintCmdCallback callback) {
+  if (cmdState == FINGERPRINT_CMD_PENDING)
+    return false;
+
+  rxSink = sink;
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_UPLOAD, slot);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start a template download into a character buffer without
+   waiting for the sensor. Once the sensor acknowledges, commandLoop() writes
+   the data packets as the source provides their bytes, one packet per call,
+   so the data can arrive from elsewhere while the transfer runs. The result
+   of downloadModel() is reported through the callback or commandResult()
+    @param   slot The character buffer to download into
+    @param   source Called for each piece of template data
+    @param   length Size of the template in bytes
+    @param   callback Called when the download completes, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::downloadModelAsync(
+    uint8_t slot, FingerprintDataSource source, uint16_t length,
+    FingerprintCmdCallback callback) {
+  if (cmdState == FINGERPRINT_CMD_PENDING)
+    return false;
+
+  txSource = source;
+  txLeft = length;
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_DOWNLOAD, slot);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start a 1:1 match of slot 1 against slot 2 without waiting for
+   the sensor. On completion the matching score is in <b>confidence</b>
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::fingerMatchAsync(FingerprintCmdCallback callback) {
+  BEGIN_STATIC_CMD_PACKET(callback, FINGERPRINT_MATCH);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start a high speed search without waiting for the sensor. On
+   completion the match is in <b>fingerID</b> and <b>confidence</b>
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::fingerFastSearchAsync(FingerprintCmdCallback callback) {
+  return fingerFastSearchAsync(1, 0, capacity, callback);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start a library search without waiting for the sensor. On
+   completion the match is in <b>fingerID</b> and <b>confidence</b>
+    @param   slot The slot to use for the print search, defaults to 1
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::fingerSearchAsync(uint8_t slot,
+                                    FingerprintCmdCallback callback) {
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_SEARCH, slot, 0x00, 0x00,
+                   (uint8_t)(capacity >> 8), (uint8_t)(capacity & 0xFF));
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start a library search over a page range without waiting for the
+   sensor. On completion the match is in <b>fingerID</b> and <b>confidence</b>
+    @param   slot The slot to use for the print search
+    @param   startPage The first library page to search
+    @param   pageCount How many pages to search from startPage
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::fingerSearchAsync(
+    uint8_t slot, uint16_t startPage, uint16_t pageCount,
+    FingerprintCmdCallback callback) {
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_SEARCH, slot,
+                   (uint8_t)(startPage >> 8), (uint8_t)(startPage & 0xFF),
+                   (uint8_t)(pageCount >> 8), (uint8_t)(pageCount & 0xFF));
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start a high speed search over a page range without waiting for
+   the sensor. On completion the match is in <b>fingerID</b> and
+   <b>confidence</b>
+    @param   slot The slot to use for the print search
+    @param   startPage The first library page to search
+    @param   pageCount How many pages to search from startPage
+    @param   callback Called when the acknowledge is received, may be NULL
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::fingerFastSearchAsync(
+    uint8_t slot, uint16_t startPage, uint16_t pageCount,
+    FingerprintCmdCallback callback) {
+  BEGIN_CMD_PACKET(callback, FINGERPRINT_HISPEEDSEARCH, slot,
+                   (uint8_t)(startPage >> 8), (uint8_t)(startPage & 0xFF),
+                   (uint8_t)(pageCount >> 8), (uint8_t)(pageCount & 0xFF));
+}
+
+/**************************************************************************/
+/*!
+    @brief   Send a command packet and return straight away. The acknowledge
+   is collected by commandLoop(), which must be called regularly
+    @param   data The command payload, starting with the instruction code
+    @param   length Size of the payload, at most FINGERPRINT_CMD_MAXLEN
+    @param   callback Called with the opcode and confirmation code once the
+   command completes, may be NULL
+    @param   timeout How many milliseconds we're willing to wait for the
+   acknowledge. FINGERPRINT_POLICY_TIMEOUT takes the timeout and resends of the
+   opcode's policy, any other value sends the command once
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::beginCommand(const uint8_t *data, uint8_t length,
+                               FingerprintCmdCallback callback,
+                               uint16_t timeout) {
+  if (cmdState == FINGERPRINT_CMD_PENDING || length > sizeof(cmdData))
+    return false;
+
+  // keep a copy of the payload so a corrupted acknowledge can be retried
+  memcpy(cmdData, data, length);
+  cmdFrame = NULL;
+  cmdLength = length;
+  cmdOpcode = data[0];
+  return startCommand(callback, timeout);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Send a complete command frame stored in flash and return straight
+   away. See Fingerprint_StaticPacket for building the frame
+    @param   frame The frame in PROGMEM, start code through checksum
+    @param   length Size of the frame
+    @param   callback Called with the opcode and confirmation code once the
+   command completes, may be NULL
+    @param   timeout How many milliseconds we're willing to wait for the
+   acknowledge, FINGERPRINT_POLICY_TIMEOUT for the opcode's policy
+    @returns True if the command was sent, false if another one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::beginCommand_P(const uint8_t *frame, uint8_t length,
+                                 FingerprintCmdCallback callback,
+                                 uint16_t timeout) {
+  if (cmdState == FINGERPRINT_CMD_PENDING)
+    return false;
+
+  cmdFrame = frame;
+  cmdLength = length;
+  cmdOpcode = pgm_read_byte(frame + 9);
+  return startCommand(callback, timeout);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Arm the engine for the command just recorded and send it
+    @param   callback Completion callback, may be NULL
+    @param   timeout Acknowledge timeout in milliseconds, or
+   FINGERPRINT_POLICY_TIMEOUT
+    @returns True, the command is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::startCommand(FingerprintCmdCallback callback,
+                               uint16_t timeout) {
+  Fingerprint_CmdPolicy policy;
+  loadPolicy(cmdOpcode, &policy);
+
+  cmdCallback = callback;
+  cmdLatency = policy.latency;
+  if (timeout == FINGERPRINT_POLICY_TIMEOUT) {
+    cmdTimeout = policy.timeout;
+    cmdRetries = policy.retries;
+  } else {
+    cmdTimeout = timeout;
+    cmdRetries = 0;
+  }
+  sendCommand();
+  cmdState = FINGERPRINT_CMD_PENDING;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Look up the timeout and retry policy of a command
+    @param   opcode The instruction code
+    @param   policy Filled in with the opcode's entry, or the default one
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::loadPolicy(uint8_t opcode,
+                                        Fingerprint_CmdPolicy *policy) {
+  const Fingerprint_CmdPolicy *entry = fingerprintCmdPolicy;
+  const Fingerprint_CmdPolicy *last =
+      &fingerprintCmdPolicy[sizeof(fingerprintCmdPolicy) /
+                                sizeof(fingerprintCmdPolicy[0]) -
+                            1];
+
+  while (entry != last && pgm_read_byte(&entry->opcode) != opcode)
+    entry++;
+  memcpy_P(policy, entry, sizeof(*policy));
+}
+
+/**************************************************************************/
+/*!
+    @brief   Put the recorded command on the wire and start its acknowledge
+   timer
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::sendCommand(void) {
+  // drop anything left over from an earlier, abandoned exchange
+  while (mySerial->available())
+    mySerial->read();
+  resetParser();
+
+  if (cmdFrame) {
+    for (uint8_t i = 0; i < cmdLength; i++)
+      mySerial->write(pgm_read_byte(cmdFrame + i));
+  } else {
+    writeCommandPacket(cmdData, cmdLength);
+  }
+  cmdStartMillis = millis();
+}
+
+/**************************************************************************/
+/*!
+    @brief   Pump the command engine: consume whatever bytes the serial port
+   has buffered and complete the command in flight on acknowledge or timeout.
+   Never blocks, call it from the main loop
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::commandLoop(void) {
+  if (cmdState != FINGERPRINT_CMD_PENDING)
+    return;
+
+  if (cmdSending) {
+    // the sensor says nothing until the last data packet is in
+    sendData();
+    return;
+  }
+
+  uint8_t status = receive(&rxPacket);
+  if (status != FINGERPRINT_PARSING) {
+    if (status == FINGERPRINT_OK && cmdStreaming) {
+      // the payload of an upload data packet already went to the sink
+      if (rxPacket.type == FINGERPRINT_DATAPACKET) {
+        cmdStartMillis = millis();
+        return;
+      }
+      if (rxPacket.type != FINGERPRINT_ENDDATAPACKET)
+        status = FINGERPRINT_BADPACKET;
+      finishCommand(status);
+      return;
+    }
+    if (status == FINGERPRINT_OK && rxPacket.type != FINGERPRINT_ACKPACKET)
+      status = FINGERPRINT_BADPACKET;
+    if (status == FINGERPRINT_OK && rxPacket.data[0] == FINGERPRINT_OK) {
+      if (rxSink) {
+        // the data packets follow the acknowledge straight away, each one
+        // gets the command timeout
+        cmdStreaming = true;
+        cmdRetries = 0;
+        cmdStartMillis = millis();
+        return;
+      }
+      if (txSource) {
+        // the data packets follow the acknowledge, each one restarts the
+        // command timeout
+        cmdSending = true;
+        cmdRetries = 0;
+        txPacketLeft = 0;
+        cmdStartMillis = millis();
+        sendData();
+        return;
+      }
+    }
+    if (status == FINGERPRINT_BADPACKET && cmdRetries) {
+      // the acknowledge was corrupted on the wire, ask again rather than
+      // report a result we can't trust
+      cmdRetries--;
+      cmdResends++;
+      sendCommand();
+      return;
+    }
+    finishCommand(status);
+    return;
+  }
+
+  if ((millis() - cmdStartMillis) >= cmdTimeout) {
+#ifdef FINGERPRINT_DEBUG
+    if (debugPort)
+      debugPort->println("Timed out");
+#endif
+    if (cmdRetries) {
+      // the command or its acknowledge was lost, the policy timeout is only a
+      // few times the usual latency so asking again is cheaper than waiting
+      cmdRetries--;
+      cmdResends++;
+      sendCommand();
+      return;
+    }
+    finishCommand(FINGERPRINT_TIMEOUT);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   Collect the result of the last asynchronous command and release
+   the engine for the next one
+    @returns The confirmation code of the command, or
+   <code>FINGERPRINT_PACKETRECIEVEERR</code> on communication error
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::commandResult(void) {
+  if (cmdState == FINGERPRINT_CMD_DONE)
+    cmdState = FINGERPRINT_CMD_IDLE;
+  return cmdResult;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Send a command and wait for its acknowledge. Blocking front-end to
+   the command engine used by the synchronous API
+    @param   data The command payload, starting with the instruction code
+    @param   length Size of the payload
+    @returns <code>FINGERPRINT_OK</code> when an acknowledge was received into
+   <b>rxPacket</b>
+    @returns <code>FINGERPRINT_TIMEOUT</code> or
+   <code>FINGERPRINT_BADPACKET</code> on failure
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::runCommand(const uint8_t *data, uint8_t length) {
+  // let an asynchronous command in flight finish first
+  while (cmdState == FINGERPRINT_CMD_PENDING)
+    commandLoop();
+
+  if (!beginCommand(data, length))
+    return FINGERPRINT_BADPACKET;
+  return awaitCommand();
+}
+
+/**************************************************************************/
+/*!
+    @brief   Send a command frame stored in flash and wait for its acknowledge
+    @param   frame The frame in PROGMEM, start code through checksum
+    @param   length Size of the frame
+    @returns <code>FINGERPRINT_OK</code> when an acknowledge was received into
+   <b>rxPacket</b>
+    @returns <code>FINGERPRINT_TIMEOUT</code> or
+   <code>FINGERPRINT_BADPACKET</code> on failure
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::runCommand_P(const uint8_t *frame, uint8_t length) {
+  while (cmdState == FINGERPRINT_CMD_PENDING)
+    commandLoop();
+
+  beginCommand_P(frame, length);
+  return awaitCommand();
+}
+
+/**************************************************************************/
+/*!
+    @brief   Pump the engine until the command in flight completes
+    @returns The transport status of the command
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::awaitCommand(void) {
+  while (cmdState == FINGERPRINT_CMD_PENDING)
+    commandLoop();
+
+  cmdState = FINGERPRINT_CMD_IDLE;
+  return cmdStatus;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Complete the command in flight and signal the result
+    @param   status Transport status of the exchange
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::finishCommand(uint8_t status) {
+  cmdStatus = status;
+  lastLatency = millis() - cmdStartMillis;
+  if (status == FINGERPRINT_OK && lastLatency > cmdLatency)
+    cmdSlow++;
+  cmdCount++;
+  if (status == FINGERPRINT_OK && cmdStreaming) {
+    // the packet buffer holds template data, not the acknowledge
+    cmdResult = FINGERPRINT_OK;
+  } else if (status == FINGERPRINT_OK) {
+    cmdResult = rxPacket.data[0];
+    decodeResponse(cmdOpcode);
+  } else {
+    cmdResult = FINGERPRINT_PACKETRECIEVEERR;
+    cmdFailures++;
+  }
+  cmdStreaming = false;
+  cmdSending = false;
+  rxSink = NULL;
+  txSource = NULL;
+  cmdState = FINGERPRINT_CMD_DONE;
+
+  if (cmdCallback)
+    cmdCallback(cmdOpcode, cmdResult);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Fill in the member variables carried by an acknowledge
+    @param   opcode The instruction code the acknowledge answers
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::decodeResponse(uint8_t opcode) {
+  switch (opcode) {
+  case FINGERPRINT_SEARCH:
+  case FINGERPRINT_HISPEEDSEARCH:
+    fingerID = ((uint16_t)rxPacket.data[1] << 8) | rxPacket.data[2];
+    confidence = ((uint16_t)rxPacket.data[3] << 8) | rxPacket.data[4];
+    break;
+  case FINGERPRINT_MATCH:
+    confidence = ((uint16_t)rxPacket.data[1] << 8) | rxPacket.data[2];
+    break;
+  case FINGERPRINT_TEMPLATECOUNT:
+    templateCount = ((uint16_t)rxPacket.data[1] << 8) | rxPacket.data[2];
+    break;
+  case FINGERPRINT_READSYSPARAM:
+    decodeParameters();
+    break;
+  default:
+    updateShadow(opcode);
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   Fill in the parameter members from a system parameter
+   acknowledge, and mark them in step with the sensor
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::decodeParameters(void) {
+  Fingerprint_Packet &packet = rxPacket;
+
+  paramsValid = (packet.data[0] == FINGERPRINT_OK);
+  if (!paramsValid)
+    return;
+
+  status_reg = ((uint16_t)packet.data[1] << 8) | packet.data[2];
+  system_id = ((uint16_t)packet.data[3] << 8) | packet.data[4];
+  capacity = ((uint16_t)packet.data[5] << 8) | packet.data[6];
+  security_level = ((uint16_t)packet.data[7] << 8) | packet.data[8];
+  device_addr = ((uint32_t)packet.data[9] << 24) |
+                ((uint32_t)packet.data[10] << 16) |
+                ((uint32_t)packet.data[11] << 8) | (uint32_t)packet.data[12];
+  packet_len = ((uint16_t)packet.data[13] << 8) | packet.data[14];
+  if (packet_len == 0) {
+    packet_len = 32;
+  } else if (packet_len == 1) {
+    packet_len = 64;
+  } else if (packet_len == 2) {
+    packet_len = 128;
+  } else if (packet_len == 3) {
+    packet_len = 256;
+  }
+  baud_rate = (((uint16_t)packet.data[15] << 8) | packet.data[16]) * 9600UL;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Apply an acknowledged command that changes the sensor state to
+   the shadow of that state
+    @param   opcode The instruction code of the command
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::updateShadow(uint8_t opcode) {
+  bool ok = (rxPacket.data[0] == FINGERPRINT_OK);
+
+  switch (opcode) {
+  case FINGERPRINT_AURALEDCONFIG:
+    memcpy(ledShadow, cmdData + 1, sizeof(ledShadow));
+    ledShadowValid = ok && cmdData[4] == 0;
+    break;
+  case FINGERPRINT_LEDON:
+  case FINGERPRINT_LEDOFF:
+    ledShadowValid = false;
+    break;
+  case FINGERPRINT_WRITE_REG:
+    if (!ok)
+      break;
+    if (cmdData[1] == FINGERPRINT_BAUD_REG_ADDR)
+      baud_rate = cmdData[2] * 9600UL;
+    else if (cmdData[1] == FINGERPRINT_SECURITY_REG_ADDR)
+      security_level = cmdData[2];
+    else if (cmdData[1] == FINGERPRINT_PACKET_REG_ADDR)
+      packet_len = 32U << cmdData[2];
+    else
+      paramsValid = false;
+    break;
+  case FINGERPRINT_STORE:
+    if (ok && shadowIndex != NULL)
+      shadowIndex->markUsed(((uint16_t)cmdData[2] << 8) | cmdData[3]);
+    break;
+  case FINGERPRINT_DELETE:
+    if (ok && shadowIndex != NULL) {
+      uint16_t id = ((uint16_t)cmdData[1] << 8) | cmdData[2];
+      uint16_t count = ((uint16_t)cmdData[3] << 8) | cmdData[4];
+      while (count--)
+        shadowIndex->markFree(id++);
+    }
+    break;
+  case FINGERPRINT_EMPTY:
+    if (ok && shadowIndex != NULL)
+      shadowIndex->begin(capacity);
+    break;
+  default:
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   Stream a command packet straight from its payload, computing the
+   checksum on the way out, without staging it in a Fingerprint_Packet
+    @param   data The command payload, starting with the instruction code
+    @param   length Size of the payload
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::writeCommandPacket(const uint8_t *data, uint8_t length) {
+  uint16_t sum = writeHeader(FINGERPRINT_COMMANDPACKET, length + 2);
+  for (uint8_t i = 0; i < length; i++) {
+    mySerial->write(data[i]);
+    sum += data[i];
+  }
+
+  mySerial->write((uint8_t)(sum >> 8));
+  mySerial->write((uint8_t)(sum & 0xFF));
+}
+
+/**************************************************************************/
+/*!
+    @brief   Check whether an Aura LED command would only repeat the effect
+   already running, counting the hit
+    @param control The control code
+    @param speed The breathing/blinking speed
+    @param coloridx The color
+    @param count Repeats of the effect, 0 if endless
+    @returns True if the command can be skipped
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::ledShadowed(uint8_t control, uint8_t speed,
+                                         uint8_t coloridx, uint8_t count) {
+  // an effect with a count has to be restarted to run again
+  if (ledShadowValid && count == 0 && ledShadow[0] == control &&
+      ledShadow[1] == speed && ledShadow[2] == coloridx) {
+    ledShadowHits++;
+    return true;
+  }
+  return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Check whether a register write would only repeat the packet
+   length or security level the parameters already hold, counting the hit
+    @param   regAdd Register address
+    @param   value Value to write to the register
+    @returns True if the write can be skipped
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::registerShadowed(uint8_t regAdd, uint8_t value) {
+  if (paramsValid &&
+      ((regAdd == FINGERPRINT_PACKET_REG_ADDR && packet_len == (32U << value)) ||
+       (regAdd == FINGERPRINT_SECURITY_REG_ADDR && security_level == value))) {
+    paramShadowHits++;
+    return true;
+  }
+  return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start a register write without waiting for the sensor. A write
+   the parameters already hold isn't sent and leaves the engine as it is
+    @param   regAdd Register address
+    @param   value Value to write to the register
+    @returns True if the command was sent or wasn't needed, false if another
+   one is in flight
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::writeRegisterAsync(uint8_t regAdd,
+                                                uint8_t value) {
+  if (registerShadowed(regAdd, value))
+    return true;
+
+  BEGIN_CMD_PACKET(NULL, FINGERPRINT_WRITE_REG, regAdd, value);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Start sending the password once, waiting only
+   <code>FINGERPRINT_PROBE_TIMEOUT</code> for the acknowledge
+    @returns True if the command was sent
+*/
+/**************************************************************************/
+template <class Transport>
+bool Fingerprint<Transport>::probe(void) {
+  uint8_t data[] = {FINGERPRINT_VERIFYPASSWORD, (uint8_t)(thePassword >> 24),
+                    (uint8_t)(thePassword >> 16), (uint8_t)(thePassword >> 8),
+                    (uint8_t)(thePassword & 0xFF)};
+
+  return beginCommand(data, sizeof(data), NULL, FINGERPRINT_PROBE_TIMEOUT);
+}
+
+/**************************************************************************/
+/*!
+    @brief   The rate of the next boot handshake probe. Every other probe goes
+   to the begin() rate, the others walk the scan table
+    @returns The baud rate
+*/
+/**************************************************************************/
+template <class Transport>
+uint32_t Fingerprint<Transport>::nextScanBaud(void) {
+  uint8_t step = scanStep;
+  scanStep = (scanStep + 1) % (2 * sizeof(fingerprintBaudScan));
+
+  if ((step & 1) == 0)
+    return safeBaud;
+  return 9600UL * pgm_read_byte(&fingerprintBaudScan[step / 2]);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Restart the transport at a new baud rate, dropping anything half
+   received at the old one
+    @param   baud The new baud rate
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::switchTransport(uint32_t baud) {
+  mySerial->begin(baud);
+  while (mySerial->available())
+    mySerial->read();
+  resetParser();
+  linkBaud = baud;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Write the start code, address, type and length of a packet
+    @param   type Command, data or end of data packet
+    @param   wire_length The length field, payload plus checksum
+    @returns The checksum of the header fields, for the payload to add to
+*/
+/**************************************************************************/
+template <class Transport>
+uint16_t Fingerprint<Transport>::writeHeader(uint8_t type,
+                                             uint16_t wire_length) {
+  mySerial->write((uint8_t)(FINGERPRINT_STARTCODE >> 8));
+  mySerial->write((uint8_t)(FINGERPRINT_STARTCODE & 0xFF));
+  mySerial->write((uint8_t)(theAddress >> 24));
+  mySerial->write((uint8_t)(theAddress >> 16));
+  mySerial->write((uint8_t)(theAddress >> 8));
+  mySerial->write((uint8_t)(theAddress & 0xFF));
+  mySerial->write(type);
+  mySerial->write((uint8_t)(wire_length >> 8));
+  mySerial->write((uint8_t)(wire_length & 0xFF));
+
+  return (wire_length >> 8) + (wire_length & 0xFF) + type;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Write the next part of an acknowledged download, <b>packet_len</b>
+   bytes per data packet. The payload is taken from the source as it becomes
+   available and at most one packet is completed per call. A source that fails,
+   or provides nothing for the command timeout, is replaced by zeros through to
+   the end packet so the sensor finishes the transfer before the next command
+   frame, and the download is reported as <code>FINGERPRINT_BADPACKET</code>
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::sendData(void) {
+  uint8_t chunk[16];
+
+  if (txSource && (millis() - cmdStartMillis) >= cmdTimeout)
+    txSource = NULL;
+
+  while (txLeft > 0) {
+    if (txPacketLeft == 0) {
+      txPacketLeft = (txLeft < packet_len) ? txLeft : packet_len;
+      txSum = writeHeader((txLeft == txPacketLeft) ? FINGERPRINT_ENDDATAPACKET
+                                                   : FINGERPRINT_DATAPACKET,
+                          txPacketLeft + 2);
+    }
+
+    uint16_t want =
+        (txPacketLeft < sizeof(chunk)) ? txPacketLeft : sizeof(chunk);
+    uint16_t got = txSource ? txSource(chunk, want) : 0;
+    if (got == FINGERPRINT_SOURCE_FAILED) {
+      // the source has failed, pad out the rest of the transfer
+      txSource = NULL;
+      got = 0;
+    }
+    if (!txSource) {
+      memset(chunk, 0, want);
+      got = want;
+    }
+    if (got == 0)
+      return;
+
+    for (uint16_t i = 0; i < got; i++) {
+      mySerial->write(chunk[i]);
+      txSum += chunk[i];
+    }
+    txPacketLeft -= got;
+    txLeft -= got;
+    cmdStartMillis = millis();
+
+    if (txPacketLeft == 0) {
+      mySerial->write((uint8_t)(txSum >> 8));
+      mySerial->write((uint8_t)(txSum & 0xFF));
+      if (txLeft > 0)
+        return;
+    }
+  }
+
+  // the acknowledge of the download command is still in rxPacket
+  finishCommand(txSource ? FINGERPRINT_OK : FINGERPRINT_BADPACKET);
+}
+
+/**************************************************************************/
+/*!
+    @brief   Helper function to process a packet and send it over UART to the
+   sensor
+    @param   packet A structure containing the bytes to transmit
+*/
+/**************************************************************************/
+
+template <class Transport>
+void Fingerprint<Transport>::writeStructuredPacket(
+    const Fingerprint_Packet &packet) {
+
+  mySerial->write((uint8_t)(packet.start_code >> 8));
+  mySerial->write((uint8_t)(packet.start_code & 0xFF));
+  mySerial->write(packet.address[0]);
+  mySerial->write(packet.address[1]);
+  mySerial->write(packet.address[2]);
+  mySerial->write(packet.address[3]);
+  mySerial->write(packet.type);
+
+  uint16_t wire_length = packet.length + 2;
+  mySerial->write((uint8_t)(wire_length >> 8));
+  mySerial->write((uint8_t)(wire_length & 0xFF));
+
+#ifdef FINGERPRINT_DEBUG
+  if (debugPort) {
+    debugPort->print("-> 0x");
+    debugPort->print((uint8_t)(packet.start_code >> 8), HEX);
+    debugPort->print(", 0x");
+    debugPort->print((uint8_t)(packet.start_code & 0xFF), HEX);
+    debugPort->print(", 0x");
+    debugPort->print(packet.address[0], HEX);
+    debugPort->print(", 0x");
+    debugPort->print(packet.address[1], HEX);
+    debugPort->print(", 0x");
+    debugPort->print(packet.address[2], HEX);
+    debugPort->print(", 0x");
+    debugPort->print(packet.address[3], HEX);
+    debugPort->print(", 0x");
+    debugPort->print(packet.type, HEX);
+    debugPort->print(", 0x");
+    debugPort->print((uint8_t)(wire_length >> 8), HEX);
+    debugPort->print(", 0x");
+    debugPort->print((uint8_t)(wire_length & 0xFF), HEX);
+  }
+#endif
+
+  uint16_t sum = ((wire_length) >> 8) + ((wire_length)&0xFF) + packet.type;
+  for (uint8_t i = 0; i < packet.length; i++) {
+    mySerial->write(packet.data[i]);
+    sum += packet.data[i];
+#ifdef FINGERPRINT_DEBUG
+    if (debugPort) {
+      debugPort->print(", 0x");
+      debugPort->print(packet.data[i], HEX);
+    }
+#endif
+  }
+
+  mySerial->write((uint8_t)(sum >> 8));
+  mySerial->write((uint8_t)(sum & 0xFF));
+
+#ifdef FINGERPRINT_DEBUG
+  if (debugPort) {
+    debugPort->print(", 0x");
+    debugPort->print((uint8_t)(sum >> 8), HEX);
+    debugPort->print(", 0x");
+    debugPort->println((uint8_t)(sum & 0xFF), HEX);
+  }
+#endif
+
+  return;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Helper function to receive data over UART from the sensor and
+   process it into a packet
+    @param   packet A structure containing the bytes received
+    @param   timeout how many milliseconds we're willing to wait
+    @returns <code>FINGERPRINT_OK</code> on success
+    @returns <code>FINGERPRINT_TIMEOUT</code> or
+   <code>FINGERPRINT_BADPACKET</code> on failure
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::getStructuredPacket(Fingerprint_Packet *packet,
+                                          uint16_t timeout) {
+  uint16_t timer = 0;
+
+#ifdef FINGERPRINT_DEBUG
+  if (debugPort)
+    debugPort->print("<- ");
+#endif
+
+  resetParser();
+  while (true) {
+    uint8_t status = receive(packet);
+    if (status != FINGERPRINT_PARSING)
+      return status;
+
+    delay(1);
+    timer++;
+    if (timer >= timeout) {
+#ifdef FINGERPRINT_DEBUG
+      if (debugPort)
+        debugPort->println("Timed out");
+#endif
+      return FINGERPRINT_TIMEOUT;
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   Parse the bytes the transport has buffered in place, a run of
+   contiguous bytes at a time, and release them once parsed. Used for
+   transports with peekContiguous() and consume()
+    @param   port The transport
+    @param   packet Packet being received
+    @returns <code>FINGERPRINT_PARSING</code> if the buffered bytes ran out
+   first, otherwise the status of the completed packet. Bytes after the
+   packet stay buffered
+*/
+/**************************************************************************/
+template <class Transport>
+template <class Port>
+auto Fingerprint<Transport>::receiveFrom(Port *port, Fingerprint_Packet *packet,
+                                         int)
+    -> decltype(port->peekContiguous((const uint8_t **)NULL), uint8_t()) {
+  const uint8_t *data;
+  uint8_t length;
+
+  while ((length = port->peekContiguous(&data)) != 0) {
+    for (uint8_t i = 0; i < length; i++) {
+      uint8_t status = parseByte(packet, data[i]);
+      if (status != FINGERPRINT_PARSING) {
+        port->consume(i + 1);
+        return status;
+      }
+    }
+    port->consume(length);
+  }
+  return FINGERPRINT_PARSING;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Parse the bytes the transport has buffered, one read() at a time.
+   Used for transports without the span reads
+    @param   port The transport
+    @param   packet Packet being received
+    @returns <code>FINGERPRINT_PARSING</code> if the buffered bytes ran out
+   first, otherwise the status of the completed packet
+*/
+/**************************************************************************/
+template <class Transport>
+template <class Port>
+uint8_t Fingerprint<Transport>::receiveFrom(Port *port,
+                                            Fingerprint_Packet *packet, long) {
+  while (port->available()) {
+    uint8_t status = parseByte(packet, port->read());
+    if (status != FINGERPRINT_PARSING)
+      return status;
+  }
+  return FINGERPRINT_PARSING;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Restart the receive parser at the start code of a new packet
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::resetParser(void) {
+  rxIdx = 0;
+  rxSum = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Drop the packet being parsed and hunt for the next start code.
+   The byte that broke the packet may itself be the start of the next one
+    @param   byte The byte that broke the packet
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::resyncParser(uint8_t byte) {
+  rxResyncs++;
+  resetParser();
+  if (byte == (FINGERPRINT_STARTCODE >> 8))
+    rxIdx = 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   Feed one received byte to the resumable packet parser. The header
+   is sanity checked as it arrives and the trailing checksum is verified, a
+   malformed header makes the parser resynchronise on the next start code
+    @param   packet A structure receiving the packet being parsed
+    @param   byte The next byte from the UART
+    @returns <code>FINGERPRINT_PARSING</code> while the packet is incomplete
+    @returns <code>FINGERPRINT_OK</code> once a whole, valid packet was
+   received. <b>length</b> then holds the payload size without the checksum
+    @returns <code>FINGERPRINT_BADPACKET</code> if the checksum didn't match
+*/
+/**************************************************************************/
+template <class Transport>
+uint8_t Fingerprint<Transport>::parseByte(Fingerprint_Packet *packet, uint8_t byte) {
+#ifdef FINGERPRINT_DEBUG
+  if (debugPort) {
+    debugPort->print("0x");
+    debugPort->print(byte, HEX);
+    debugPort->print(", ");
+  }
+#endif
+  switch (rxIdx) {
+  case 0:
+    if (byte != (FINGERPRINT_STARTCODE >> 8))
+      return FINGERPRINT_PARSING;
+    break;
+  case 1:
+    if (byte != (FINGERPRINT_STARTCODE & 0xFF)) {
+      resyncParser(byte);
+      return FINGERPRINT_PARSING;
+    }
+    packet->start_code = FINGERPRINT_STARTCODE;
+    break;
+  case 2:
+  case 3:
+  case 4:
+  case 5:
+    if (byte != (uint8_t)(theAddress >> (8 * (5 - rxIdx)))) {
+      resyncParser(byte);
+      return FINGERPRINT_PARSING;
+    }
+    packet->address[rxIdx - 2] = byte;
+    break;
+  case 6:
+    if (byte != FINGERPRINT_COMMANDPACKET && byte != FINGERPRINT_DATAPACKET &&
+        byte != FINGERPRINT_ACKPACKET && byte != FINGERPRINT_ENDDATAPACKET) {
+      resyncParser(byte);
+      return FINGERPRINT_PARSING;
+    }
+    packet->type = byte;
+    rxSum = byte;
+    break;
+  case 7:
+    packet->length = (uint16_t)byte << 8;
+    rxSum += byte;
+    break;
+  case 8:
+    packet->length |= byte;
+    rxSum += byte;
+    // the length covers the checksum, and the payload has to fit the buffer
+    // unless a streamed data packet goes to the sink
+    if (packet->length < 2 ||
+        packet->length > (streamingPacket(packet) ? FINGERPRINT_DATA_MAXLEN
+                                                  : sizeof(packet->data)) +
+                             2) {
+      resyncParser(byte);
+      return FINGERPRINT_PARSING;
+    }
+    break;
+  default: {
+    uint16_t pos = rxIdx - 9;
+    uint16_t payload = packet->length - 2;
+    if (pos < payload) {
+      rxSum += byte;
+      if (!streamingPacket(packet)) {
+        packet->data[pos] = byte;
+      } else {
+        // stage the payload in the packet buffer and hand it over when full
+        uint8_t staged = pos % sizeof(packet->data);
+        packet->data[staged] = byte;
+        if (staged == sizeof(packet->data) - 1 || pos == payload - 1)
+          rxSink(packet->data, staged + 1);
+      }
+    } else if (pos == payload) {
+      // high byte of the checksum
+      rxSum ^= (uint16_t)byte << 8;
+    } else {
+      rxSum ^= byte;
+      bool valid = (rxSum == 0);
+      resetParser();
+      if (!valid) {
+#ifdef FINGERPRINT_DEBUG
+        if (debugPort)
+          debugPort->println(" BAD CHECKSUM ");
+#endif
+        rxChecksumErrors++;
+        return FINGERPRINT_BADPACKET;
+      }
+#ifdef FINGERPRINT_DEBUG
+      if (debugPort)
+        debugPort->println(" OK ");
+#endif
+      packet->length = payload;
+      return FINGERPRINT_OK;
+    }
+    break;
+  }
+  }
+  rxIdx++;
+  return FINGERPRINT_PARSING;
+}
+
+#if defined(__AVR__) || defined(ESP8266)
+/**************************************************************************/
+/*!
+    @brief   Attach a callback signalled when a finger is placed on, or removed
+   from the sensor
+    @param   callback The function to call with the new touch state
+*/
+/**************************************************************************/
+template <class Transport>
+void Fingerprint<Transport>::attachTouchCallback(
+    void (*callback)(FingerTouchState_t state)) {
+  FingerprintSerial::fingerTouchCallback = callback;
+}
+#endif
+
+/***************************************************************************
+ TRANSPORT INSTANTIATIONS
+ ***************************************************************************/
+
+#if defined(__AVR__) || defined(ESP8266)
+template class Fingerprint<FingerprintSensorSerial>;
+#endif
+#ifdef FINGERPRINT_UART_TRANSPORT
+template class Fingerprint<FingerprintUart>;
+#endif
@@ -6,8 +6,15 @@
  */
 
 #include "Arduino.h"
+#include "FingerprintIndex.h"
 #if defined(__AVR__) || defined(ESP8266)
 #include "FingerprintSerial.h"
+#include "FingerprintUart.h"
+
+#define FINGERPRINT_SERIAL_RX_BUFF                                             \
+  128 //!< Receive buffer of the sensor's soft serial port, a 128-byte packet
+///! The soft serial port the sensor is wired to
+typedef FingerprintSerialPort<FINGERPRINT_SERIAL_RX_BUFF> FingerprintSensorSerial;
 #endif
 
 #define FINGERPRINT_OK 0x00               //!< Command execution is complete
@@ -53,17 +60,29 @@
 
 #define FINGERPRINT_TIMEOUT 0xFF   //!< Timeout was reached
 #define FINGERPRINT_BADPACKET 0xFE //!< Bad packet was sent
+#define FINGERPRINT_PARSING 0xFD   //!< Packet reception still in progress
+#define FINGERPRINT_PENDING 0xFC   //!< Multi-step operation still in progress
+
+#define FINGERPRINT_CMD_IDLE 0x00 //!< No command in flight
+#define FINGERPRINT_CMD_PENDING                                                \
+  0x01 //!< Command sent, waiting for the acknowledge packet
+#define FINGERPRINT_CMD_DONE                                                   \
+  0x02 //!< Command complete, result available through commandResult()
 
 #define FINGERPRINT_GETIMAGE 0x01 //!< Collect finger image
 #define FINGERPRINT_IMAGE2TZ 0x02 //!< Generate character file from image
+#define FINGERPRINT_MATCH                                                      \
+  0x03 //!< Compare the character files in slots 1 and 2
 #define FINGERPRINT_SEARCH 0x04   //!< Search for fingerprint in slot
 #define FINGERPRINT_REGMODEL                                                   \
   0x05 //!< Combine character files and generate template
 #define FINGERPRINT_STORE 0x06          //!< Store template
 #define FINGERPRINT_LOAD 0x07           //!< Read/load template
 #define FINGERPRINT_UPLOAD 0x08         //!< Upload template
+#define FINGERPRINT_DOWNLOAD 0x09       //!< Download template
 #define FINGERPRINT_DELETE 0x0C         //!< Delete templates
 #define FINGERPRINT_EMPTY 0x0D          //!< Empty library
+#define FINGERPRINT_WRITE_REG 0x0E      //!< Write system parameter (SetSysPara)
 #define FINGERPRINT_READSYSPARAM 0x0F   //!< Read system parameters
 #define FINGERPRINT_SETPASSWORD 0x12    //!< Sets passwords
 #define FINGERPRINT_VERIFYPASSWORD 0x13 //!< Verifies the password
@@ -71,6 +90,8 @@
   0x1B //!< Asks the sensor to search for a matching fingerprint template to the
        //!< last model generated
 #define FINGERPRINT_TEMPLATECOUNT 0x1D //!< Read finger template numbers
+#define FINGERPRINT_READINDEXTABLE                                             \
+  0x1F //!< Read the occupancy bitmap of the template library
 #define FINGERPRINT_AURALEDCONFIG 0x35 //!< Aura LED control
 #define FINGERPRINT_LEDON 0x50         //!< Turn on the onboard LED
 #define FINGERPRINT_LEDOFF 0x51        //!< Turn off the onboard LED
@@ -85,13 +106,135 @@
 #define FINGERPRINT_LED_BLUE 0x02        //!< Blue LED
 #define FINGERPRINT_LED_PURPLE 0x03      //!< Purple LED
 
+#define FINGERPRINT_BAUD_REG_ADDR 0x4   //!< BAUDRATE register address
+#define FINGERPRINT_BAUDRATE_9600 0x1   //!< UART baud 9600
+#define FINGERPRINT_BAUDRATE_19200 0x2  //!< UART baud 19200
+#define FINGERPRINT_BAUDRATE_28800 0x3  //!< UART baud 28800
+#define FINGERPRINT_BAUDRATE_38400 0x4  //!< UART baud 38400
+#define FINGERPRINT_BAUDRATE_48000 0x5  //!< UART baud 48000
+#define FINGERPRINT_BAUDRATE_57600 0x6  //!< UART baud 57600
+#define FINGERPRINT_BAUDRATE_67200 0x7  //!< UART baud 67200
+#define FINGERPRINT_BAUDRATE_76800 0x8  //!< UART baud 76800
+#define FINGERPRINT_BAUDRATE_86400 0x9  //!< UART baud 86400
+#define FINGERPRINT_BAUDRATE_96000 0xA  //!< UART baud 96000
+#define FINGERPRINT_BAUDRATE_105600 0xB //!< UART baud 105600
+#define FINGERPRINT_BAUDRATE_115200 0xC //!< UART baud 115200
+
+#define FINGERPRINT_SECURITY_REG_ADDR 0x5 //!< Security level register address
+
+#define FINGERPRINT_PACKET_REG_ADDR 0x6 //!< Packet size register address
+#define FINGERPRINT_PACKET_SIZE_32 0x0  //!< Packet size is 32 Byte
+#define FINGERPRINT_PACKET_SIZE_64 0x1  //!< Packet size is 64 Byte
+#define FINGERPRINT_PACKET_SIZE_128 0x2 //!< Packet size is 128 Byte
+#define FINGERPRINT_PACKET_SIZE_256 0x3 //!< Packet size is 256 Byte
+
+#define FINGERPRINT_LINK_PROBES                                                \
+  4 //!< Handshakes a new baud rate has to pass without a single bad packet
+#define FINGERPRINT_PROBE_TIMEOUT                                              \
+  100 //!< Time a boot handshake waits for an answer at one baud rate, in ms
+
 //#define FINGERPRINT_DEBUG
 
+#ifndef FINGERPRINT_SPAN_READ
+#define FINGERPRINT_SPAN_READ                                                  \
+  1 //!< Parse transports with span reads in place, 0 reads them a byte at a
+    //!< time to compare the two
+#endif
+
 #define DEFAULTTIMEOUT 1000 //!< UART reading timeout in milliseconds
+#define FINGERPRINT_POLICY_TIMEOUT                                             \
+  0 //!< Command timeout argument that takes the timeout of the opcode's policy
+#define FINGERPRINT_CMD_MAXLEN                                                 \
+  8 //!< Longest command payload accepted by beginCommand()
+#define FINGERPRINT_DATA_MAXLEN                                                \
+  256 //!< Longest data packet payload, the largest sensor packet length
+#define FINGERPRINT_SOURCE_FAILED                                              \
+  0xFFFF //!< Returned by a data source that can't provide the rest of the data
+
+/**************************************************************************/
+/*!
+    @brief   Sum of the bytes covered by a packet checksum, evaluated at
+   compile time
+    @returns 0 for the empty tail of the recursion
+*/
+/**************************************************************************/
+constexpr uint16_t fingerprintChecksum() { return 0; }
+
+/**************************************************************************/
+/*!
+    @brief   Sum of the bytes covered by a packet checksum, evaluated at
+   compile time
+    @param   first The next byte to add
+    @param   rest The remaining bytes
+    @returns The 16-bit sum
+*/
+/**************************************************************************/
+template <typename... Rest>
+constexpr uint16_t fingerprintChecksum(uint8_t first, Rest... rest) {
+  return first + fingerprintChecksum(rest...);
+}
+
+///! A complete command packet with constant arguments, checksum included,
+///! generated by the compiler straight into flash
+template <uint8_t... Payload> struct Fingerprint_StaticPacket {
+  /// Length field of the packet, the payload plus the checksum
+  static constexpr uint16_t wire_length = sizeof...(Payload) + 2;
+  /// Checksum over the packet type, length and payload
+  static constexpr uint16_t checksum =
+      fingerprintChecksum(FINGERPRINT_COMMANDPACKET, wire_length >> 8,
+                          wire_length & 0xFF, Payload...);
+  /// The raw frame, start code through checksum, in PROGMEM
+  static const uint8_t frame[sizeof...(Payload) + 11];
+};
+
+template <uint8_t... Payload>
+const uint8_t Fingerprint_StaticPacket<Payload...>::frame
+    [sizeof...(Payload) + 11] PROGMEM = {
+        (uint8_t)(FINGERPRINT_STARTCODE >> 8),
+        (uint8_t)(FINGERPRINT_STARTCODE & 0xFF),
+        0xFF,
+        0xFF,
+        0xFF,
+        0xFF,
+        FINGERPRINT_COMMANDPACKET,
+        (uint8_t)(wire_length >> 8),
+        (uint8_t)(wire_length & 0xFF),
+        Payload...,
+        (uint8_t)(checksum >> 8),
+        (uint8_t)(checksum & 0xFF)};
+
+///! How long a command should take, how long to wait for its acknowledge and
+///! how often to send it again when the acknowledge is lost or corrupted
+typedef struct {
+  uint8_t opcode;   ///< Instruction code
+  uint16_t latency; ///< Usual send to acknowledge time, in milliseconds
+  uint16_t timeout; ///< Time to wait for the acknowledge, in milliseconds
+  uint8_t retries;  ///< Resends allowed, 0 for commands that aren't idempotent
+} Fingerprint_CmdPolicy;
+
+///! Callback signalled when an asynchronous command completes
+typedef void (*FingerprintCmdCallback)(uint8_t opcode, uint8_t result);
+
+///! Callback receiving template data as it streams in from the sensor. The
+///! chunks are handed over before the checksum of their packet is checked, so
+///! keep them until the transfer reports success
+typedef void (*FingerprintDataSink)(const uint8_t *data, uint16_t length);
+
+///! Callback providing template data to stream out to the sensor, it fills in
+///! up to length bytes and returns how many it wrote. 0 means none are ready
+///! yet, FINGERPRINT_SOURCE_FAILED that the rest of the data won't come
+typedef uint16_t (*FingerprintDataSource)(uint8_t *data, uint16_t length);
 
 ///! Helper class to craft UART packets
 struct Fingerprint_Packet {
 
+  /**************************************************************************/
+  /*!
+      @brief   Create an empty packet, to be filled in by the receive parser
+  */
+  /**************************************************************************/
+  Fingerprint_Packet() : start_code(0), type(0), length(0) {}
+
   /**************************************************************************/
   /*!
       @brief   Create a new UART-borne packet
@@ -122,36 +265,119 @@ struct Fingerprint_Packet {
   uint8_t data[64];    ///< The raw buffer for packet payload
 };
 
-///! Helper class to communicate with and keep state for fingerprint sensors
-class Fingerprint {
+///! Helper class to communicate with and keep state for fingerprint sensors.
+///! Transport is the serial class the sensor is wired to; it needs begin(),
+///! available(), read() and write(uint8_t), and is called directly so the
+///! compiler can inline the byte I/O. The instantiations the firmware links
+///! against are listed at the end of Fingerprint.cpp
+template <class Transport> class Fingerprint {
 public:
-#if defined(__AVR__) || defined(ESP8266) || defined(FREEDOM_E300_HIFIVE1)
-  Fingerprint(FingerprintSerial *ss, uint32_t password = 0x0);
-#endif
-  Fingerprint(HardwareSerial *hs, uint32_t password = 0x0);
-  Fingerprint(Stream *serial, uint32_t password = 0x0);
+  Fingerprint(Transport *transport, uint32_t password = 0x0);
 
   void begin(uint32_t baud);
 
   boolean verifyPassword(void);
+  uint8_t handshake(uint16_t budget);
+  uint8_t handshakeLoop(void);
   uint8_t getParameters(void);
+  bool getParametersAsync(FingerprintCmdCallback callback = NULL);
 
   uint8_t getImage(void);
   uint8_t image2Tz(uint8_t slot = 1);
   uint8_t createModel(void);
 
   uint8_t emptyDatabase(void);
-  uint8_t storeModel(uint16_t id);
-  uint8_t loadModel(uint16_t id);
+  uint8_t storeModel(uint16_t id, uint8_t slot = 1);
+  uint8_t loadModel(uint16_t id, uint8_t slot = 1);
   uint8_t getModel(void);
+  uint8_t uploadModel(uint8_t slot, FingerprintDataSink sink);
+  uint8_t downloadModel(uint8_t slot, FingerprintDataSource source,
+                        uint16_t length);
   uint8_t deleteModel(uint16_t id);
+  uint8_t fingerMatch(void);
   uint8_t fingerFastSearch(void);
+  uint8_t fingerFastSearch(uint8_t slot, uint16_t startPage,
+                           uint16_t pageCount);
   uint8_t fingerSearch(uint8_t slot = 1);
+  uint8_t fingerSearch(uint8_t slot, uint16_t startPage, uint16_t pageCount);
   uint8_t getTemplateCount(void);
+  bool getTemplateCountAsync(FingerprintCmdCallback callback = NULL);
+  uint8_t readIndexTable(uint8_t page);
+  bool readIndexTableAsync(uint8_t page,
+                           FingerprintCmdCallback callback = NULL);
+  uint8_t loadIndex(FingerprintIndex *index);
+  bool beginLoadIndex(FingerprintIndex *index);
+  uint8_t loadIndexLoop(void);
+  void attachIndex(FingerprintIndex *index);
+  void invalidateShadow(void);
   uint8_t setPassword(uint32_t password);
+  uint8_t writeRegister(uint8_t regAdd, uint8_t value);
+  uint8_t setBaudRate(uint8_t baudrate);
+  uint8_t setPacketSize(uint8_t size);
+  uint8_t negotiateLink(uint32_t baud, uint8_t packetSize);
+  bool beginNegotiateLink(uint32_t baud, uint8_t packetSize);
+  uint8_t negotiateLinkLoop(void);
+  uint8_t fallbackLink(void);
+  bool beginFallbackLink(void);
+  /// Step the fallback started by beginFallbackLink(), alongside
+  /// commandLoop(). It shares the steps and results of negotiateLinkLoop()
+  uint8_t fallbackLinkLoop(void) { return negotiateLinkLoop(); }
+  /// The baud rate the transport runs at
+  uint32_t linkBaudRate(void) { return linkBaud; }
+  /// True if the link runs faster than the rate it was negotiated up from
+  bool linkRaised(void) { return linkBaud != safeBaud; }
+#ifdef FINGERPRINT_DEBUG
+  /// Send the FINGERPRINT_DEBUG packet traces to port, NULL drops them. They
+  /// go to Serial unless FINGERPRINT_UART_TRANSPORT is defined: Serial shares
+  /// USART0 with the sensor then, and nothing is traced until a port is set
+  void setDebugPort(Print *port) { debugPort = port; }
+#endif
+  /// Receive errors seen so far: bad checksums, start code hunts and the
+  /// framing errors of transports that count them
+  uint16_t rxErrors(void) {
+    return rxChecksumErrors + rxResyncs + framingErrorsOf(mySerial, 0);
+  }
   uint8_t LEDcontrol(bool on);
   uint8_t LEDcontrol(uint8_t control, uint8_t speed, uint8_t coloridx,
                      uint8_t count = 0);
+  bool LEDcontrolAsync(uint8_t control, uint8_t speed, uint8_t coloridx,
+                       uint8_t count = 0,
+                       FingerprintCmdCallback callback = NULL);
+
+  bool verifyPasswordAsync(FingerprintCmdCallback callback = NULL);
+  bool getImageAsync(FingerprintCmdCallback callback = NULL);
+  bool image2TzAsync(uint8_t slot = 1, FingerprintCmdCallback callback = NULL);
+  bool createModelAsync(FingerprintCmdCallback callback = NULL);
+  bool loadModelAsync(uint16_t id, uint8_t slot = 1,
+                      FingerprintCmdCallback callback = NULL);
+  bool storeModelAsync(uint16_t id, uint8_t slot = 1,
+                       FingerprintCmdCallback callback = NULL);
+  bool deleteModelAsync(uint16_t id, FingerprintCmdCallback callback = NULL);
+  bool uploadModelAsync(uint8_t slot, FingerprintDataSink sink,
+                        FingerprintCmdCallback callback = NULL);
+  bool downloadModelAsync(uint8_t slot, FingerprintDataSource source,
+                          uint16_t length,
+                          FingerprintCmdCallback callback = NULL);
+  bool fingerMatchAsync(FingerprintCmdCallback callback = NULL);
+  bool fingerFastSearchAsync(FingerprintCmdCallback callback = NULL);
+  bool fingerSearchAsync(uint8_t slot = 1,
+                         FingerprintCmdCallback callback = NULL);
+  bool fingerFastSearchAsync(uint8_t slot, uint16_t startPage,
+                             uint16_t pageCount,
+                             FingerprintCmdCallback callback = NULL);
+  bool fingerSearchAsync(uint8_t slot, uint16_t startPage, uint16_t pageCount,
+                         FingerprintCmdCallback callback = NULL);
+
+  bool beginCommand(const uint8_t *data, uint8_t length,
+                    FingerprintCmdCallback callback = NULL,
+                    uint16_t timeout = FINGERPRINT_POLICY_TIMEOUT);
+  bool beginCommand_P(const uint8_t *frame, uint8_t length,
+                      FingerprintCmdCallback callback = NULL,
+                      uint16_t timeout = FINGERPRINT_POLICY_TIMEOUT);
+  void commandLoop(void);
+  /// The state of the command engine (FINGERPRINT_CMD_IDLE, _PENDING, _DONE)
+  uint8_t commandState(void) { return cmdState; }
+  uint8_t commandResult(void);
 
   void writeStructuredPacket(const Fingerprint_Packet &p);
   uint8_t getStructuredPacket(Fingerprint_Packet *p,
@@ -159,8 +385,8 @@ public:
 
   /// The matching location that is set by fingerFastSearch()
   uint16_t fingerID;
-  /// The confidence of the fingerFastSearch() match, higher numbers are more
-  /// confidents
+  /// The confidence of the fingerFastSearch() or fingerMatch() match, higher
+  /// numbers are more confidents
   uint16_t confidence;
   /// The number of stored templates in the sensor, set by getTemplateCount()
   uint16_t templateCount;
@@ -172,22 +398,128 @@ public:
   uint32_t device_addr =
       0xFFFFFFFF;             ///< The device address (set by getParameters)
   uint16_t packet_len = 64;   ///< The max packet length (set by getParameters)
-  uint16_t baud_rate = 57600; ///< The UART baud rate (set by getParameters)
+  uint32_t baud_rate = 57600; ///< The UART baud rate (set by getParameters)
+
+  uint16_t rxChecksumErrors = 0; ///< Received packets dropped on bad checksum
+  uint16_t rxResyncs = 0; ///< Times the parser hunted for a new start code
+  uint16_t cmdResends = 0; ///< Commands resent after a lost or bad acknowledge
+  uint16_t cmdSlow = 0; ///< Commands answered later than their policy latency
+  uint16_t cmdCount = 0;    ///< Commands completed, answered or not
+  uint16_t cmdFailures = 0; ///< Commands that got no valid acknowledge
+  uint16_t lastLatency = 0; ///< Send to acknowledge time of the last command, ms
+  uint16_t ledShadowHits = 0;   ///< LED commands skipped, the LED already set
+  uint16_t paramShadowHits = 0; ///< Parameter reads and writes answered locally
+  uint16_t countShadowHits = 0; ///< Template counts answered from the index
 
+#if defined(__AVR__) || defined(ESP8266)
   // interface to attach a touch callback for the fingerprint
   void attachTouchCallback(void (*callback)(FingerTouchState_t state));
+#endif
 
 private:
   uint8_t checkPassword(void);
+  uint8_t runCommand(const uint8_t *data, uint8_t length);
+  uint8_t runCommand_P(const uint8_t *frame, uint8_t length);
+  uint8_t awaitCommand(void);
+  bool startCommand(FingerprintCmdCallback callback, uint16_t timeout);
+  void loadPolicy(uint8_t opcode, Fingerprint_CmdPolicy *policy);
+  void sendCommand(void);
+  void writeCommandPacket(const uint8_t *data, uint8_t length);
+  uint16_t writeHeader(uint8_t type, uint16_t wire_length);
+  void sendData(void);
+  void finishCommand(uint8_t status);
+  void decodeResponse(uint8_t opcode);
+  void decodeParameters(void);
+  void updateShadow(uint8_t opcode);
+  void resetParser(void);
+  void resyncParser(uint8_t byte);
+  uint8_t parseByte(Fingerprint_Packet *packet, uint8_t byte);
+  /// Parse the bytes the transport has buffered. Transports with the
+  /// zero-copy peekContiguous() and consume() are read in place, the overload
+  /// taking an int only exists for them. A long argument always picks the
+  /// byte-wise overload
+  uint8_t receive(Fingerprint_Packet *packet) {
+#if FINGERPRINT_SPAN_READ
+    return receiveFrom(mySerial, packet, 0);
+#else
+    return receiveFrom(mySerial, packet, 0L);
+#endif
+  }
+  template <class Port>
+  auto receiveFrom(Port *port, Fingerprint_Packet *packet, int)
+      -> decltype(port->peekContiguous((const uint8_t **)NULL), uint8_t());
+  template <class Port>
+  uint8_t receiveFrom(Port *port, Fingerprint_Packet *packet, long);
+  /// Framing errors of the transport, the long overload covers transports
+  /// without rxFramingErrors()
+  template <class Port>
+  auto framingErrorsOf(Port *port, int) -> decltype(port->rxFramingErrors()) {
+    return port->rxFramingErrors();
+  }
+  template <class Port> uint16_t framingErrorsOf(Port *, long) { return 0; }
+  /// True if the payload of the packet is handed to rxSink, not buffered
+  bool streamingPacket(const Fingerprint_Packet *packet) {
+    return rxSink && (packet->type == FINGERPRINT_DATAPACKET ||
+                      packet->type == FINGERPRINT_ENDDATAPACKET);
+  }
+  bool ledShadowed(uint8_t control, uint8_t speed, uint8_t coloridx,
+                   uint8_t count);
+  bool registerShadowed(uint8_t regAdd, uint8_t value);
+  bool writeRegisterAsync(uint8_t regAdd, uint8_t value);
+  bool probe(void);
+  uint32_t nextScanBaud(void);
+  void switchTransport(uint32_t baud);
   uint32_t thePassword;
+  uint32_t linkBaud; ///< Baud rate the transport runs at
+  uint32_t safeBaud; ///< Baud rate to fall back to if the link degrades
+  uint16_t safePacketLen; ///< Packet length to restore with safeBaud
+  uint8_t scanStep;  ///< Position of the boot handshake in its baud rate scan
+  uint8_t linkStep;  ///< Step of the link negotiation in progress
+  uint32_t linkTarget; ///< Baud rate the negotiation tries
+  uint32_t linkFrom;   ///< Baud rate the negotiation started at
+  uint8_t linkPacketSize; ///< Packet size code written once the rate holds
+  uint8_t linkProbes;  ///< Handshakes the new rate has passed so far
+  uint16_t linkErrors; ///< Bad packets counted when the probes started
+  FingerprintIndex *indexTarget; ///< Index being loaded, NULL if none
+  uint8_t indexPage;   ///< Index table page being read
+  uint8_t indexPages;  ///< Index table pages to read
+
+  FingerprintIndex *shadowIndex; ///< Occupancy kept in step with the library
+  uint8_t ledShadow[3];  ///< Aura LED control, speed and color last set
+  bool ledShadowValid;   ///< The LED runs the steady effect in ledShadow
+  bool paramsValid;      ///< The parameter members match the sensor
   uint32_t theAddress;
   uint8_t recvPacket[20];
 
-  Stream *mySerial;
-#if defined(__AVR__) || defined(ESP8266) || defined(FREEDOM_E300_HIFIVE1)
-  FingerprintSerial *swSerial;
+  Fingerprint_Packet rxPacket; ///< Acknowledge of the last command
+  uint16_t rxIdx;              ///< Receive parser position in the packet
+  uint16_t rxSum;              ///< Running checksum of the packet
+  FingerprintDataSink rxSink;  ///< Receives data packet payloads, NULL if none
+  FingerprintDataSource txSource; ///< Provides the data packets to send once
+                                  ///< acknowledged, NULL if none
+  uint16_t txLeft;       ///< Download bytes still to send
+  uint16_t txPacketLeft; ///< Payload bytes still to send in the open packet
+  uint16_t txSum;        ///< Running checksum of the open data packet
+  bool cmdStreaming; ///< Acknowledged, data packets of the upload follow
+  bool cmdSending;   ///< Acknowledged, data packets of the download are sent
+
+  uint8_t cmdState;                   ///< Command engine state
+  uint8_t cmdOpcode;                  ///< Opcode of the command in flight
+  uint8_t cmdData[FINGERPRINT_CMD_MAXLEN]; ///< Payload kept for a resend
+  const uint8_t *cmdFrame; ///< Flash frame of the command, NULL if in cmdData
+  uint8_t cmdLength;       ///< Size of the kept payload or flash frame
+  uint8_t cmdRetries;                 ///< Resends left for the command
+  uint16_t cmdLatency;                ///< Usual acknowledge time of the command
+  uint8_t cmdStatus;                  ///< Transport status of the last command
+  uint8_t cmdResult;                  ///< Confirmation code of the last command
+  uint16_t cmdTimeout;                ///< Acknowledge timeout in milliseconds
+  unsigned long cmdStartMillis;       ///< Time the command was sent
+  FingerprintCmdCallback cmdCallback; ///< Completion callback, may be NULL
+
+  Transport *mySerial;
+#ifdef FINGERPRINT_DEBUG
+  Print *debugPort; ///< Where the packet traces go, NULL for nowhere
 #endif
-  HardwareSerial *hwSerial;
 };
 
 #endif
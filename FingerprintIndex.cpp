@@ -0,0 +1,235 @@
+/*!
+ * @file FingerprintIndex.cpp
+ *
+ * Occupancy bitmap of the fingerprint sensor template library. Locations are
+ * handed out lowest-first so the used range stays packed at the bottom of the
+ * library, which keeps search ranges tight
+ *
+ * BSD license, all text above must be included in any redistribution
+ *
+ */
+
+#include "FingerprintIndex.h"
+
+/***************************************************************************
+ PUBLIC FUNCTIONS
+ ***************************************************************************/
+
+/**************************************************************************/
+/*!
+    @brief  Instantiates an empty index, call begin() with the sensor capacity
+   before use
+*/
+/**************************************************************************/
+FingerprintIndex::FingerprintIndex(void) { begin(0); }
+
+/**************************************************************************/
+/*!
+    @brief  Clears the index and sets the number of locations it tracks
+    @param  capacity The template capacity of the sensor, clamped to
+   FINGERPRINT_INDEX_MAX
+*/
+/**************************************************************************/
+void FingerprintIndex::begin(uint16_t capacity) {
+  memset(bits, 0, sizeof(bits));
+  limit = capacity < FINGERPRINT_INDEX_MAX ? capacity : FINGERPRINT_INDEX_MAX;
+  rescan();
+}
+
+/**************************************************************************/
+/*!
+    @brief  Loads one page of the sensor index table, as returned by the
+   ReadIndexTable command
+    @param  page The index table page, each covers 256 locations
+    @param  table FINGERPRINT_INDEX_PAGE_BYTES bytes, bit 0 of the first byte
+   being the first location of the page
+*/
+/**************************************************************************/
+void FingerprintIndex::loadPage(uint8_t page, const uint8_t *table) {
+  uint16_t first = (uint16_t)page * FINGERPRINT_INDEX_PAGE_BYTES;
+
+  for (uint8_t i = 0; i < FINGERPRINT_INDEX_PAGE_BYTES; i++) {
+    uint16_t byte = first + i;
+    if (byte >= sizeof(bits))
+      break;
+    bits[byte] = table[i];
+  }
+
+  // drop anything the sensor reports past the tracked capacity
+  for (uint16_t byte = limit / 8; byte < sizeof(bits); byte++)
+    bits[byte] &= (byte == limit / 8) ? (uint8_t)((1 << (limit % 8)) - 1) : 0;
+
+  rescan();
+}
+
+/**************************************************************************/
+/*!
+    @brief  Checks whether a location holds a template
+    @param  id The template location
+    @returns True if the location is used
+*/
+/**************************************************************************/
+bool FingerprintIndex::isUsed(uint16_t id) {
+  if (id >= limit)
+    return false;
+  return bits[id >> 3] & (1 << (id & 7));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Records a template stored at a location
+    @param  id The template location
+*/
+/**************************************************************************/
+void FingerprintIndex::markUsed(uint16_t id) {
+  if (id >= limit || isUsed(id))
+    return;
+
+  bits[id >> 3] |= (1 << (id & 7));
+  if (used++ == 0) {
+    lowest = highest = id;
+  } else {
+    if (id < lowest)
+      lowest = id;
+    if (id > highest)
+      highest = id;
+  }
+  if (id == freeHint)
+    freeHint = nextFree(id);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Records a template deleted from a location
+    @param  id The template location
+*/
+/**************************************************************************/
+void FingerprintIndex::markFree(uint16_t id) {
+  if (!isUsed(id))
+    return;
+
+  bits[id >> 3] &= ~(1 << (id & 7));
+  used--;
+  if (id < freeHint)
+    freeHint = id;
+  if (used == 0)
+    return;
+  if (id == lowest)
+    lowest = nextUsed(id);
+  if (id == highest)
+    highest = prevUsed(id);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Picks the location for the next template. The lowest free
+   location is kept up to date on every change, so this doesn't scan
+    @returns The lowest free location, FINGERPRINT_INDEX_NONE if the library
+   is full
+*/
+/**************************************************************************/
+uint16_t FingerprintIndex::allocate(void) {
+  return freeHint < limit ? freeHint : FINGERPRINT_INDEX_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief  The first page a library search has to cover
+    @returns The lowest used location, 0 if the library is empty
+*/
+/**************************************************************************/
+uint16_t FingerprintIndex::searchStart(void) { return used ? lowest : 0; }
+
+/**************************************************************************/
+/*!
+    @brief  The number of pages a library search has to cover, starting at
+   searchStart()
+    @returns The span of the used locations, 0 if the library is empty
+*/
+/**************************************************************************/
+uint16_t FingerprintIndex::searchCount(void) {
+  return used ? highest - lowest + 1 : 0;
+}
+
+/***************************************************************************
+ PRIVATE FUNCTIONS
+ ***************************************************************************/
+
+/**************************************************************************/
+/*!
+    @brief  Recomputes the count, bounds and free location from the bitmap
+*/
+/**************************************************************************/
+void FingerprintIndex::rescan(void) {
+  used = 0;
+  for (uint16_t byte = 0; byte < sizeof(bits); byte++)
+    for (uint8_t b = bits[byte]; b; b &= b - 1)
+      used++;
+
+  lowest = nextUsed(0);
+  highest = prevUsed(limit);
+  freeHint = nextFree(0);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Finds the lowest free location at or above a location, skipping
+   full bytes
+    @param  from The location to start at
+    @returns The free location, limit if there is none
+*/
+/**************************************************************************/
+uint16_t FingerprintIndex::nextFree(uint16_t from) {
+  while (from < limit) {
+    if ((from & 7) == 0 && bits[from >> 3] == 0xFF) {
+      from += 8;
+      continue;
+    }
+    if (!isUsed(from))
+      return from;
+    from++;
+  }
+  return limit;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Finds the lowest used location at or above a location, skipping
+   empty bytes
+    @param  from The location to start at
+    @returns The used location, FINGERPRINT_INDEX_NONE if there is none
+*/
+/**************************************************************************/
+uint16_t FingerprintIndex::nextUsed(uint16_t from) {
+  while (from < limit) {
+    if ((from & 7) == 0 && bits[from >> 3] == 0) {
+      from += 8;
+      continue;
+    }
+    if (isUsed(from))
+      return from;
+    from++;
+  }
+  return FINGERPRINT_INDEX_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Finds the highest used location below a location, skipping empty
+   bytes
+    @param  from The location to search down from, not included
+    @returns The used location, FINGERPRINT_INDEX_NONE if there is none
+*/
+/**************************************************************************/
+uint16_t FingerprintIndex::prevUsed(uint16_t from) {
+  while (from > 0) {
+    if ((from & 7) == 0 && bits[(from >> 3) - 1] == 0) {
+      from -= 8;
+      continue;
+    }
+    from--;
+    if (isUsed(from))
+      return from;
+  }
+  return FINGERPRINT_INDEX_NONE;
+}
@@ -0,0 +1,54 @@
+#ifndef FINGERPRINT_INDEX_H
+#define FINGERPRINT_INDEX_H
+
+/*!
+ * @file FingerprintIndex.h
+ */
+
+#include "Arduino.h"
+
+#ifndef FINGERPRINT_INDEX_MAX
+#define FINGERPRINT_INDEX_MAX                                                  \
+  1024 //!< Most template locations tracked, four sensor index table pages
+#endif
+#define FINGERPRINT_INDEX_PAGE_BYTES                                           \
+  32 //!< Bytes in one page of the sensor index table
+#define FINGERPRINT_INDEX_NONE 0xFFFF //!< No such template location
+
+///! In-RAM occupancy bitmap of the sensor template library, one bit per
+///! location, loaded from the sensor index table and kept up to date as
+///! templates are stored and deleted
+class FingerprintIndex {
+public:
+  FingerprintIndex(void);
+
+  void begin(uint16_t capacity);
+  void loadPage(uint8_t page, const uint8_t *bits);
+
+  bool isUsed(uint16_t id);
+  void markUsed(uint16_t id);
+  void markFree(uint16_t id);
+
+  uint16_t allocate(void);
+  /// The number of stored templates
+  uint16_t count(void) { return used; }
+  /// The number of locations tracked
+  uint16_t capacity(void) { return limit; }
+  uint16_t searchStart(void);
+  uint16_t searchCount(void);
+
+private:
+  void rescan(void);
+  uint16_t nextFree(uint16_t from);
+  uint16_t nextUsed(uint16_t from);
+  uint16_t prevUsed(uint16_t from);
+
+  uint8_t bits[FINGERPRINT_INDEX_MAX / 8]; ///< Bit n set if location n is used
+  uint16_t limit;    ///< Locations tracked, the sensor capacity
+  uint16_t used;     ///< Number of set bits
+  uint16_t lowest;   ///< Lowest used location
+  uint16_t highest;  ///< Highest used location
+  uint16_t freeHint; ///< Lowest free location, limit when full
+};
+
+#endif
@@ -42,20 +42,32 @@ http://arduiniana.org.
 #include <Arduino.h>
 #include "FingerprintSerial.h"
 #include <util/delay_basic.h>
+#include <util/atomic.h>
 #include "timing_driver.h"
 //
 // Statics
 //
-FingerprintSerial *FingerprintSerial::active_object = 0;
-uint8_t FingerprintSerial::_receive_buffer[_SS_MAX_RX_BUFF]; 
-volatile uint8_t FingerprintSerial::_receive_buffer_tail = 0;
-volatile uint8_t FingerprintSerial::_receive_buffer_head = 0;
+FingerprintSerialBase *FingerprintSerialBase::active_object = 0;
+FingerprintSerialBase *FingerprintSerialBase::tx_object = 0;
+uint16_t FingerprintSerialBase::_tx_frame = 0;
+uint8_t FingerprintSerialBase::_tx_bits = 0;
+uint8_t FingerprintSerialBase::_rx_byte = 0;
+uint8_t FingerprintSerialBase::_rx_bits = 0;
+#if _SS_RX_STATS
+volatile uint32_t FingerprintSerialBase::rxIsrCycles = 0;
+volatile uint32_t FingerprintSerialBase::rxIsrBytes = 0;
+#define RX_STATS_START() uint16_t isrStart = TCNT1
+#define RX_STATS_END() (rxIsrCycles += (uint16_t)(TCNT1 - isrStart))
+#else
+#define RX_STATS_START()
+#define RX_STATS_END()
+#endif
 
 volatile bool previousTouchState = false;
 volatile long previousTouchMillis = 0;
 
 // Pointer to touch callback function
-void (*FingerprintSerial::fingerTouchCallback)(FingerTouchState_t state);
+void (*FingerprintSerialBase::fingerTouchCallback)(FingerTouchState_t state);
 //
 // Debugging
 //
@@ -82,13 +94,13 @@ inline void DebugPulse(uint8_t, uint8_t) {}
 //
 
 /* static */ 
-inline void FingerprintSerial::tunedDelay(uint16_t delay) { 
+inline void FingerprintSerialBase::tunedDelay(uint16_t delay) { 
   _delay_loop_2(delay);
 }
 
 // This function sets the current object as the "listening"
 // one and returns true if it replaces another 
-bool FingerprintSerial::listen()
+bool FingerprintSerialBase::listen()
 {
   if (!_rx_delay_stopbit)
     return false;
@@ -110,7 +122,7 @@ bool FingerprintSerial::listen()
 }
 
 // Stop listening. Returns true if we were actually listening.
-bool FingerprintSerial::stopListening()
+bool FingerprintSerialBase::stopListening()
 {
   if (active_object == this)
   {
@@ -124,7 +136,7 @@ bool FingerprintSerial::stopListening()
 //
 // The receive routine called by the interrupt handler
 //
-void FingerprintSerial::recv()
+void FingerprintSerialBase::recv()
 {
 
 #if GCC_VERSION < 40302
@@ -143,6 +155,7 @@ void FingerprintSerial::recv()
     ::);
 #endif  
 
+  RX_STATS_START();
   uint8_t d = 0;
 
   // If RX line is high, then we don't see any start bit
@@ -171,27 +184,18 @@ void FingerprintSerial::recv()
     if (_inverse_logic)
       d = ~d;
 
-    // if buffer full, set the overflow flag and return
-    uint8_t next = (_receive_buffer_tail + 1) % _SS_MAX_RX_BUFF;
-    if (next != _receive_buffer_head)
-    {
-      // save new data in buffer: tail points to where byte goes
-      _receive_buffer[_receive_buffer_tail] = d; // save new byte
-      _receive_buffer_tail = next;
-    } 
-    else 
-    {
-      DebugPulse(_DEBUG_PIN1, 1);
-      _buffer_overflow = true;
-    }
+    store(d);
 
-    // skip the stop bit
+    // wait for the stop bit, a line still at space level is a framing error
     tunedDelay(_rx_delay_stopbit);
     DebugPulse(_DEBUG_PIN1, 1);
+    if (_inverse_logic ? rx_pin_read() : !rx_pin_read())
+      _receive_framing_errors++;
 
     // Re-enable interrupts when we're sure to be inside the stop bit
     setRxIntMsk(true);
 
+    RX_STATS_END();
   }
 
 #if GCC_VERSION < 40302
@@ -210,7 +214,33 @@ void FingerprintSerial::recv()
 #endif
 }
 
-uint8_t FingerprintSerial::rx_pin_read()
+// Puts a received byte in the buffer
+void FingerprintSerialBase::store(uint8_t d)
+{
+  // if buffer full, set the overflow flag and return
+  uint8_t next = (_receive_buffer_tail + 1) & _receive_mask;
+  if (next != _receive_buffer_head)
+  {
+    // save new data in buffer: tail points to where byte goes
+    _receive_buffer[_receive_buffer_tail] = d; // save new byte
+    _receive_buffer_tail = next;
+
+    uint8_t held = (next - _receive_buffer_head) & _receive_mask;
+    if (held > _receive_high_water)
+      _receive_high_water = held;
+  } 
+  else 
+  {
+    DebugPulse(_DEBUG_PIN1, 1);
+    _buffer_overflow = true;
+    _receive_overflows++;
+  }
+#if _SS_RX_STATS
+  rxIsrBytes++;
+#endif
+}
+
+uint8_t FingerprintSerialBase::rx_pin_read()
 {
   return *_receivePortRegister & _receiveBitMask;
 }
@@ -220,14 +250,135 @@ uint8_t FingerprintSerial::rx_pin_read()
 //
 
 /* static */
-inline void FingerprintSerial::handle_interrupt()
+inline void FingerprintSerialBase::handle_interrupt()
 {
-  if (active_object)
+  if (active_object && !active_object->_timer_rx)
   {
     active_object->recv();
   }
 }
 
+// Called by the input capture unit on the edge of a start bit. ICR1 holds the
+// time of the edge, the first sample goes to the middle of the start bit
+/* static */
+inline void FingerprintSerialBase::handle_capture_interrupt()
+{
+  RX_STATS_START();
+  FingerprintSerialBase *rx = active_object;
+
+  OCR1B = ICR1 + (rx->_bit_ticks >> 1);
+  TIFR1 = _BV(OCF1B);
+  TIMSK1 = (TIMSK1 & ~_BV(ICIE1)) | _BV(OCIE1B);
+  _rx_bits = 10; // start bit, 8 data bits, stop bit
+
+  RX_STATS_END();
+}
+
+// Called on each Timer1 compare match B, in the middle of a bit. Reads the
+// bit and moves the next sample one bit time on. The capture unit takes over
+// again from the middle of the stop bit, which is sampled to catch framing
+// errors
+/* static */
+inline void FingerprintSerialBase::handle_sample_interrupt()
+{
+  RX_STATS_START();
+  FingerprintSerialBase *rx = active_object;
+  bool mark = rx->_inverse_logic ? !rx->rx_pin_read() : rx->rx_pin_read();
+
+  OCR1B += rx->_bit_ticks;
+
+  switch (_rx_bits--)
+  {
+  case 10:
+    // a real start bit is still there in its middle, otherwise the edge was
+    // a glitch
+    if (!mark)
+    {
+      RX_STATS_END();
+      return;
+    }
+    TIFR1 = _BV(ICF1);
+    break;
+  case 1:
+    // the byte is kept either way, the packet checksum rejects it
+    if (!mark)
+      rx->_receive_framing_errors++;
+    rx->store(_rx_byte);
+
+    // edges captured during the data bits are dropped. One captured after
+    // this sample can only be the next start bit, half a bit on from here,
+    // and is left for the capture interrupt
+    if ((int16_t)(ICR1 - (OCR1B - rx->_bit_ticks)) <= 0)
+      TIFR1 = _BV(ICF1);
+    break;
+  default:
+    _rx_byte >>= 1;
+    if (mark)
+      _rx_byte |= 0x80;
+    RX_STATS_END();
+    return;
+  }
+
+  // look for the next start bit
+  TIMSK1 = (TIMSK1 & ~_BV(OCIE1B)) | _BV(ICIE1);
+  RX_STATS_END();
+}
+
+#if _SS_TIMER1_RX && defined(TIMER1_CAPT_vect)
+ISR(TIMER1_CAPT_vect)
+{
+  FingerprintSerialBase::handle_capture_interrupt();
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+  FingerprintSerialBase::handle_sample_interrupt();
+}
+#endif
+
+// Called on each Timer1 compare match, as the bit scheduled by the previous
+// call appears on the pin. Schedules the next bit one bit time later, so the
+// edges come from the compare unit and only the setup runs in software. The
+// setup has a whole bit time to run, an ISR holding it off for longer than
+// that corrupts the byte. The keypad scan runs with interrupts enabled so it
+// doesn't
+/* static */
+inline void FingerprintSerialBase::handle_tx_interrupt()
+{
+  FingerprintSerialBase *tx = tx_object;
+  OCR1A += tx->_bit_ticks;
+
+  if (_tx_bits == 0)
+  {
+    // the stop bit just started, the next start bit follows it a bit time
+    // later, or the line stays idle
+    if (tx->_transmit_buffer_head == tx->_transmit_buffer_tail)
+    {
+      TIMSK1 &= ~_BV(OCIE1A);
+      return;
+    }
+    // start bit, 8 data bits, stop bit
+    _tx_frame = ((uint16_t)tx->_transmit_buffer[tx->_transmit_buffer_tail] << 1) | 0x200;
+    tx->_transmit_buffer_tail = (tx->_transmit_buffer_tail + 1) & tx->_transmit_mask;
+    _tx_bits = 10;
+  }
+
+  // set or clear OC1A on the next match
+  if ((_tx_frame & 1) ^ tx->_inverse_logic)
+    TCCR1A |= _BV(COM1A0);
+  else
+    TCCR1A &= ~_BV(COM1A0);
+  _tx_frame >>= 1;
+  _tx_bits--;
+}
+
+#if _SS_TIMER1_TX && defined(TIMER1_COMPA_vect)
+ISR(TIMER1_COMPA_vect)
+{
+  FingerprintSerialBase::handle_tx_interrupt();
+}
+#endif
+
 // TODO: Differentiate between communication and touch sensing
 #if defined(PCINT0_vect)
 ISR(PCINT0_vect)
@@ -241,36 +392,52 @@ ISR(PCINT0_vect)
 //      previousTouchState = touched;
 //      if (touched)
 //      {
-//        if (!(FingerprintSerial::fingerTouchCallback)) return;
+//        if (!(FingerprintSerialBase::fingerTouchCallback)) return;
 //        cli();
-//        FingerprintSerial::fingerTouchCallback(FINGER_PLACED);
+//        FingerprintSerialBase::fingerTouchCallback(FINGER_PLACED);
 //        sei();
 //      }
 //      else
 //      {
-//        if (!(FingerprintSerial::fingerTouchCallback)) return;
+//        if (!(FingerprintSerialBase::fingerTouchCallback)) return;
 //        cli();
-//        FingerprintSerial::fingerTouchCallback(FINGER_REMOVED);
+//        FingerprintSerialBase::fingerTouchCallback(FINGER_REMOVED);
 //        sei();
 //      }
 //      return;
 //    }
 //  }
   
-  FingerprintSerial::handle_interrupt();
+  FingerprintSerialBase::handle_interrupt();
 }
 #endif
 
 //
 // Constructor
 //
-FingerprintSerial::FingerprintSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic /* = false */) : 
+FingerprintSerialBase::FingerprintSerialBase(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic,
+                                             uint8_t *receiveBuffer, uint16_t receiveSize,
+                                             uint8_t *transmitBuffer, uint16_t transmitSize) : 
   _rx_delay_centering(0),
   _rx_delay_intrabit(0),
   _rx_delay_stopbit(0),
   _tx_delay(0),
+  _bit_ticks(0),
   _buffer_overflow(false),
-  _inverse_logic(inverse_logic)
+  _inverse_logic(inverse_logic),
+  _timer_tx(false),
+  _timer_rx(false),
+  _receive_buffer(receiveBuffer),
+  _receive_mask(receiveSize - 1),
+  _receive_buffer_tail(0),
+  _receive_buffer_head(0),
+  _receive_high_water(0),
+  _receive_overflows(0),
+  _receive_framing_errors(0),
+  _transmit_buffer(transmitBuffer),
+  _transmit_mask(transmitSize - 1),
+  _transmit_buffer_tail(0),
+  _transmit_buffer_head(0)
 {
   setTX(transmitPin);
   setRX(receivePin);
@@ -280,19 +447,19 @@ FingerprintSerial::FingerprintSerial(uint8_t receivePin, uint8_t transmitPin, bo
 //
 // Destructor
 //
-FingerprintSerial::~FingerprintSerial()
+FingerprintSerialBase::~FingerprintSerialBase()
 {
   end();
 }
 
-//void FingerprintSerial::setupTouch(void)
+//void FingerprintSerialBase::setupTouch(void)
 //{
 //  // set up touch pin change interrupt to PB2
 //  PCICR |= (1 << PCIE0);
 //  PCMSK0 |= (1 << PCINT2);
 //}
 
-void FingerprintSerial::setTX(uint8_t tx)
+void FingerprintSerialBase::setTX(uint8_t tx)
 {
   // First write, then set output. If we do this the other way around,
   // the pin would be output low for a short while before switching to
@@ -303,9 +470,36 @@ void FingerprintSerial::setTX(uint8_t tx)
   _transmitBitMask = digitalPinToBitMask(tx);
   uint8_t port = digitalPinToPort(tx);
   _transmitPortRegister = portOutputRegister(port);
+  _timer_tx = _SS_TIMER1_TX && (tx == _SS_TIMER1_TX_PIN);
 }
 
-void FingerprintSerial::setRX(uint8_t rx)
+// Sets Timer1 running free in normal mode at clk/1, bit times are counted
+// from compare to compare (the keypad delay only reads the count). Call with
+// interrupts disabled
+void FingerprintSerialBase::beginTimer1()
+{
+  TCCR1A &= ~(_BV(WGM11) | _BV(WGM10));
+  // capture the falling edge of a start bit, the rising one with inverse logic
+  TCCR1B = _BV(CS10) | ((_timer_rx && _inverse_logic) ? _BV(ICES1) : 0);
+}
+
+// Hands the TX pin over to the Timer1 compare unit. Call with interrupts
+// disabled
+void FingerprintSerialBase::beginTimerTX()
+{
+  tx_object = this;
+  _tx_bits = 0;
+  _transmit_buffer_head = _transmit_buffer_tail = 0;
+  TIMSK1 &= ~_BV(OCIE1A);
+
+  // connect OC1A at the idle level, forced straight away so the pin doesn't
+  // glitch low when the compare unit takes it over
+  TCCR1A = (TCCR1A & ~(_BV(COM1A1) | _BV(COM1A0))) |
+           (_inverse_logic ? _BV(COM1A1) : (_BV(COM1A1) | _BV(COM1A0)));
+  TCCR1C = _BV(FOC1A);
+}
+
+void FingerprintSerialBase::setRX(uint8_t rx)
 {
   pinMode(rx, INPUT);
   if (!_inverse_logic)
@@ -314,9 +508,10 @@ void FingerprintSerial::setRX(uint8_t rx)
   _receiveBitMask = digitalPinToBitMask(rx);
   uint8_t port = digitalPinToPort(rx);
   _receivePortRegister = portInputRegister(port);
+  _timer_rx = _SS_TIMER1_RX && (rx == _SS_TIMER1_RX_PIN);
 }
 
-uint16_t FingerprintSerial::subtract_cap(uint16_t num, uint16_t sub) {
+uint16_t FingerprintSerialBase::subtract_cap(uint16_t num, uint16_t sub) {
   if (num > sub)
     return num - sub;
   else
@@ -327,12 +522,28 @@ uint16_t FingerprintSerial::subtract_cap(uint16_t num, uint16_t sub) {
 // Public methods
 //
 
-void FingerprintSerial::begin(long speed)
+void FingerprintSerialBase::begin(long speed)
 {
+  // let the bytes queued at the old rate go out first
+  flush();
+
   _rx_delay_centering = _rx_delay_intrabit = _rx_delay_stopbit = _tx_delay = 0;
 
   // Precalculate the various delays, in number of 4-cycle delays
   uint16_t bit_delay = (F_CPU / speed) / 4;
+  _bit_ticks = (F_CPU + speed / 2) / speed;
+  if (_timer_tx || _timer_rx)
+  {
+    uint8_t oldSREG = SREG;
+    cli();
+    beginTimer1();
+    if (_timer_tx)
+      beginTimerTX();
+    // a byte half sampled at the old rate is dropped
+    if (_timer_rx && isListening())
+      setRxIntMsk(true);
+    SREG = oldSREG;
+  }
 
   // 12 (gcc 4.8.2) or 13 (gcc 4.3.2) cycles from start bit to first bit,
   // 15 (gcc 4.8.2) or 16 (gcc 4.3.2) cycles between bits,
@@ -400,22 +611,32 @@ void FingerprintSerial::begin(long speed)
   listen();
 }
 
-void FingerprintSerial::setRxIntMsk(bool enable)
+void FingerprintSerialBase::setRxIntMsk(bool enable)
 {
-    if (enable)
+    if (_timer_rx)
+    {
+      // arm the capture unit for a start bit, or stop receiving
+      TIMSK1 &= ~(_BV(ICIE1) | _BV(OCIE1B));
+      if (enable)
+      {
+        TIFR1 = _BV(ICF1);
+        TIMSK1 |= _BV(ICIE1);
+      }
+    }
+    else if (enable)
       *_pcint_maskreg |= _pcint_maskvalue;
     else
       *_pcint_maskreg &= ~_pcint_maskvalue;
 }
 
-void FingerprintSerial::end()
+void FingerprintSerialBase::end()
 {
   stopListening();
 }
 
 
 // Read data from buffer
-int FingerprintSerial::read()
+int FingerprintSerialBase::read()
 {
   if (!isListening())
     return -1;
@@ -426,25 +647,28 @@ int FingerprintSerial::read()
 
   // Read from "head"
   uint8_t d = _receive_buffer[_receive_buffer_head]; // grab next byte
-  _receive_buffer_head = (_receive_buffer_head + 1) % _SS_MAX_RX_BUFF;
+  _receive_buffer_head = (_receive_buffer_head + 1) & _receive_mask;
   return d;
 }
 
-int FingerprintSerial::available()
+int FingerprintSerialBase::available()
 {
   if (!isListening())
     return 0;
 
-  return (_receive_buffer_tail + _SS_MAX_RX_BUFF - _receive_buffer_head) % _SS_MAX_RX_BUFF;
+  return (uint8_t)(_receive_buffer_tail - _receive_buffer_head) & _receive_mask;
 }
 
-size_t FingerprintSerial::write(uint8_t b)
+size_t FingerprintSerialBase::write(uint8_t b)
 {
   if (_tx_delay == 0) {
     setWriteError();
     return 0;
   }
 
+  if (_timer_tx)
+    return queue(b);
+
   // By declaring these as local variables, the compiler will put them
   // in registers _before_ disabling interrupts and entering the
   // critical timing sections below, which makes it a lot easier to
@@ -493,12 +717,59 @@ size_t FingerprintSerial::write(uint8_t b)
   return 1;
 }
 
-void FingerprintSerial::flush()
+// Queues a byte for the Timer1 TX mode and starts the compare interrupt if
+// the line is idle
+size_t FingerprintSerialBase::queue(uint8_t b)
+{
+  uint8_t next = (_transmit_buffer_head + 1) & _transmit_mask;
+
+  // a full queue waits for the interrupt to make room, or runs it from here if
+  // interrupts are disabled
+  while (next == _transmit_buffer_tail)
+  {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(TIFR1, OCF1A))
+    {
+      TIFR1 = _BV(OCF1A);
+      handle_tx_interrupt();
+    }
+  }
+
+  _transmit_buffer[_transmit_buffer_head] = b;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  _transmit_buffer_head = next;
+  if (bit_is_clear(TIMSK1, OCIE1A))
+  {
+    // the first match a bit time from now loads the byte, which also holds
+    // the last stop bit for its full length
+    _tx_bits = 0;
+    OCR1A = TCNT1 + _bit_ticks;
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 |= _BV(OCIE1A);
+  }
+  SREG = oldSREG;
+
+  return 1;
+}
+
+void FingerprintSerialBase::flush()
 {
-  // There is no tx buffering, simply return
+  // Only the Timer1 TX mode buffers, wait for its queue to go out
+  if (!_timer_tx || (tx_object != this))
+    return;
+
+  while (bit_is_set(TIMSK1, OCIE1A))
+  {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(TIFR1, OCF1A))
+    {
+      TIFR1 = _BV(OCF1A);
+      handle_tx_interrupt();
+    }
+  }
 }
 
-int FingerprintSerial::peek()
+int FingerprintSerialBase::peek()
 {
   if (!isListening())
     return -1;
@@ -511,7 +782,57 @@ int FingerprintSerial::peek()
   return _receive_buffer[_receive_buffer_head];
 }
 
-void FingerprintSerial::attachTouchCallback(void (*callback)(FingerTouchState_t state))
+// Points data at the oldest received byte and returns how many bytes follow
+// it without wrapping around the end of the buffer, 0 if there are none. The
+// bytes stay buffered until consume() releases them
+uint8_t FingerprintSerialBase::peekContiguous(const uint8_t **data)
+{
+  if (!isListening())
+    return 0;
+
+  uint8_t head = _receive_buffer_head;
+  uint8_t tail = _receive_buffer_tail;
+  *data = &_receive_buffer[head];
+
+  if (tail >= head)
+    return tail - head;
+  // up to the end of the buffer, the rest is returned by the next call
+  return (_receive_mask + 1) - head;
+}
+
+// Releases count bytes returned by peekContiguous()
+void FingerprintSerialBase::consume(uint8_t count)
+{
+  _receive_buffer_head = (_receive_buffer_head + count) & _receive_mask;
+}
+
+#if _SS_RX_STATS
+// Average Timer1 clocks a received byte kept the receive interrupts busy. Both
+// counters are read at once, the interrupts update them between bytes
+uint16_t FingerprintSerialBase::rxIsrCyclesPerByte()
+{
+  uint32_t cycles, bytes;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    cycles = rxIsrCycles;
+    bytes = rxIsrBytes;
+  }
+  return bytes ? cycles / bytes : 0;
+}
+#endif
+
+// bytes received without a stop bit, read with the receive interrupts held off
+uint16_t FingerprintSerialBase::rxFramingErrors()
+{
+  uint16_t errors;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    errors = _receive_framing_errors;
+  }
+  return errors;
+}
+
+void FingerprintSerialBase::attachTouchCallback(void (*callback)(FingerTouchState_t state))
 {
   fingerTouchCallback = callback;
 }
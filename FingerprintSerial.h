@@ -39,7 +39,35 @@ http://arduiniana.org.
 ******************************************************************************/
 
 #ifndef _SS_MAX_RX_BUFF
-#define _SS_MAX_RX_BUFF 64 // RX buffer size
+#define _SS_MAX_RX_BUFF 64 // default RX buffer size, a power of two
+#endif
+
+// When set, an instance transmitting on the OC1A pin (9) queues its bytes and
+// lets the Timer1 compare unit clock the bits out, instead of bit-banging them
+// with interrupts disabled. Timer1 then runs free in normal mode at clk/1
+#ifndef _SS_TIMER1_TX
+#define _SS_TIMER1_TX 1
+#endif
+#define _SS_TIMER1_TX_PIN 9
+
+// When set, an instance receiving on the ICP1 pin (8) timestamps the start bit
+// with the Timer1 input capture unit and samples each bit from a short
+// compare-match B interrupt, instead of spinning in the pin change interrupt
+// for the whole byte
+#ifndef _SS_TIMER1_RX
+#define _SS_TIMER1_RX 1
+#endif
+#define _SS_TIMER1_RX_PIN 8
+
+// When set, the receive interrupts count the Timer1 clocks they take (from
+// their first statement to their last, the register save and restore around
+// them add about 40 more). Timer1 has to run free, which either Timer1 mode
+// takes care of
+#ifndef _SS_RX_STATS
+#define _SS_RX_STATS 0
+#endif
+#ifndef _SS_MAX_TX_BUFF
+#define _SS_MAX_TX_BUFF 32 // default TX queue size, a power of two
 #endif
 
 #ifndef GCC_VERSION
@@ -51,7 +79,8 @@ typedef enum FINGER_TOUCH {
   FINGER_REMOVED
 }FingerTouchState_t;
 
-class FingerprintSerial : public Stream
+// The soft serial implementation, buffers are provided by FingerprintSerialPort
+class FingerprintSerialBase : public Stream
 {
 private:
   // per object data
@@ -68,22 +97,46 @@ private:
   uint16_t _rx_delay_intrabit;
   uint16_t _rx_delay_stopbit;
   uint16_t _tx_delay;
+  uint16_t _bit_ticks; // bit time in Timer1 clocks
 
   uint16_t _buffer_overflow:1;
   uint16_t _inverse_logic:1;
+  uint16_t _timer_tx:1; // bits are clocked out by Timer1
+  uint16_t _timer_rx:1; // bits are sampled by Timer1
+
+  // receive buffer, indexed with the size mask
+  uint8_t *_receive_buffer;
+  uint8_t _receive_mask;
+  volatile uint8_t _receive_buffer_tail;
+  volatile uint8_t _receive_buffer_head;
+  uint8_t _receive_high_water; // most bytes the buffer has held
+  uint16_t _receive_overflows; // bytes dropped on a full buffer
+  volatile uint16_t _receive_framing_errors; // bytes whose stop bit wasn't there
+
+  // transmit queue of the Timer1 TX mode
+  uint8_t *_transmit_buffer;
+  uint8_t _transmit_mask;
+  volatile uint8_t _transmit_buffer_tail;
+  volatile uint8_t _transmit_buffer_head;
 
   // static data
-  static uint8_t _receive_buffer[_SS_MAX_RX_BUFF]; 
-  static volatile uint8_t _receive_buffer_tail;
-  static volatile uint8_t _receive_buffer_head;
-  static FingerprintSerial *active_object;
+  static FingerprintSerialBase *active_object;
+  static FingerprintSerialBase *tx_object; // instance that owns the Timer1 compare unit
+  static uint16_t _tx_frame;           // bits of the byte going out, LSB next
+  static uint8_t _tx_bits;             // bits of _tx_frame still to schedule
+  static uint8_t _rx_byte;             // bits of the byte coming in, MSB last
+  static uint8_t _rx_bits;             // samples left of the byte coming in
 
   // private methods
   inline void recv() __attribute__((__always_inline__));
+  inline void store(uint8_t d) __attribute__((__always_inline__));
   uint8_t rx_pin_read();
   void setTX(uint8_t transmitPin);
   void setRX(uint8_t receivePin);
   void setupTouch(void);
+  void beginTimer1();
+  void beginTimerTX();
+  size_t queue(uint8_t byte);
   inline void setRxIntMsk(bool enable) __attribute__((__always_inline__));
 
   // Return num - sub, or 1 if the result would be < 1
@@ -92,17 +145,31 @@ private:
   // private static method for timing
   static inline void tunedDelay(uint16_t delay);
 
+protected:
+  FingerprintSerialBase(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic,
+                        uint8_t *receiveBuffer, uint16_t receiveSize,
+                        uint8_t *transmitBuffer, uint16_t transmitSize);
+
 public:
   // public methods
-  FingerprintSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic = false);
-  ~FingerprintSerial();
+  ~FingerprintSerialBase();
   void begin(long speed);
   bool listen();
   void end();
   bool isListening() { return this == active_object; }
   bool stopListening();
   bool overflow() { bool ret = _buffer_overflow; if (ret) _buffer_overflow = false; return ret; }
+  // buffer use, to size the buffers from field data
+  uint8_t rxHighWater() { return _receive_high_water; }
+  uint16_t rxOverflows() { return _receive_overflows; }
+  // bytes received without a stop bit, a link running too fast for the pins
+  uint16_t rxFramingErrors();
+  uint16_t rxBufferSize() { return _receive_mask + 1; }
   int peek();
+  // zero-copy reads: the longest run of received bytes that doesn't wrap,
+  // and releasing bytes once they've been used
+  uint8_t peekContiguous(const uint8_t **data);
+  void consume(uint8_t count);
 
   virtual size_t write(uint8_t byte);
   virtual int read();
@@ -114,6 +181,16 @@ public:
 
   // public only for easy access by interrupt handlers
   static inline void handle_interrupt() __attribute__((__always_inline__));
+  static inline void handle_tx_interrupt() __attribute__((__always_inline__));
+  static inline void handle_capture_interrupt() __attribute__((__always_inline__));
+  static inline void handle_sample_interrupt() __attribute__((__always_inline__));
+
+#if _SS_RX_STATS
+  // receive interrupt occupancy, compare the two RX modes with these
+  static volatile uint32_t rxIsrCycles; // Timer1 clocks spent in the receive interrupts
+  static volatile uint32_t rxIsrBytes;  // bytes received while counting
+  static uint16_t rxIsrCyclesPerByte();
+#endif
   // Finger touch callback from fingerprint (placed here for accessiblity of PCINT0)
   static void (*fingerTouchCallback)(FingerTouchState_t state);
 
@@ -121,4 +198,28 @@ public:
   void attachTouchCallback(void (*callback)(FingerTouchState_t state));
 };
 
+// A soft serial port with its own RX buffer and TX queue, their sizes powers
+// of two up to 256 so indices wrap with a mask.
+// final, so calls made through a pointer to it (as Fingerprint<> does) bind
+// directly instead of going through the vtable
+template <uint16_t RxSize = _SS_MAX_RX_BUFF, uint16_t TxSize = _SS_MAX_TX_BUFF>
+class FingerprintSerialPort final : public FingerprintSerialBase
+{
+  static_assert(RxSize >= 2 && RxSize <= 256 && !(RxSize & (RxSize - 1)),
+                "RX buffer size must be a power of two up to 256");
+  static_assert(TxSize >= 2 && TxSize <= 256 && !(TxSize & (TxSize - 1)),
+                "TX queue size must be a power of two up to 256");
+
+private:
+  uint8_t _receive_storage[RxSize];
+  uint8_t _transmit_storage[TxSize];
+
+public:
+  FingerprintSerialPort(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic = false) :
+    FingerprintSerialBase(receivePin, transmitPin, inverse_logic,
+                          _receive_storage, RxSize, _transmit_storage, TxSize) {}
+};
+
+typedef FingerprintSerialPort<> FingerprintSerial;
+
 #endif
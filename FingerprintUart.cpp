@@ -0,0 +1,309 @@
+/*
+Interrupt-driven hardware USART transport for the fingerprint sensor, see
+FingerprintUart.h
+*/
+
+// 
+// Includes
+// 
+#include <avr/interrupt.h>
+#include <Arduino.h>
+#include "FingerprintUart.h"
+
+#ifdef FINGERPRINT_UART_TRANSPORT
+
+#if (_UART_MAX_RX_BUFF & (_UART_MAX_RX_BUFF - 1)) || (_UART_MAX_TX_BUFF & (_UART_MAX_TX_BUFF - 1))
+#error "FingerprintUart buffer sizes must be powers of two"
+#endif
+
+#define _UART_RX_MASK (_UART_MAX_RX_BUFF - 1)
+#define _UART_TX_MASK (_UART_MAX_TX_BUFF - 1)
+
+//
+// Statics
+//
+FingerprintUart *FingerprintUart::active_object = 0;
+
+//
+// Private methods
+//
+
+void FingerprintUart::setRxIntMsk(bool enable)
+{
+  if (enable)
+    UCSR0B |= _BV(RXCIE0);
+  else
+    UCSR0B &= ~_BV(RXCIE0);
+}
+
+//
+// Interrupt handling
+//
+
+/* static */
+inline void FingerprintUart::handle_rx_interrupt()
+{
+  // the data register has to be read to clear the interrupt, even if nobody
+  // listens; the error flags belong to it and are read first
+  bool framingError = UCSR0A & _BV(FE0);
+  uint8_t d = UDR0;
+  FingerprintUart *uart = active_object;
+  if (!uart)
+    return;
+
+  // the byte is kept either way, the packet checksum rejects it
+  if (framingError)
+    uart->_receive_framing_errors++;
+
+  // if buffer full, set the overflow flag and drop the byte
+  uint8_t next = (uart->_receive_buffer_tail + 1) & _UART_RX_MASK;
+  if (next != uart->_receive_buffer_head)
+  {
+    // save new data in buffer: tail points to where byte goes
+    uart->_receive_buffer[uart->_receive_buffer_tail] = d;
+    uart->_receive_buffer_tail = next;
+  }
+  else
+  {
+    uart->_buffer_overflow = true;
+  }
+}
+
+/* static */
+inline void FingerprintUart::handle_udre_interrupt()
+{
+  FingerprintUart *uart = active_object;
+  if (!uart || (uart->_transmit_buffer_head == uart->_transmit_buffer_tail))
+  {
+    // nothing left to send
+    UCSR0B &= ~_BV(UDRIE0);
+    return;
+  }
+
+  UDR0 = uart->_transmit_buffer[uart->_transmit_buffer_tail];
+  uart->_transmit_buffer_tail = (uart->_transmit_buffer_tail + 1) & _UART_TX_MASK;
+  // clear the transmit complete flag (written as one), flush() waits on it
+  UCSR0A = _BV(U2X0) | _BV(TXC0);
+
+  if (uart->_transmit_buffer_head == uart->_transmit_buffer_tail)
+    UCSR0B &= ~_BV(UDRIE0);
+}
+
+ISR(USART_RX_vect)
+{
+  FingerprintUart::handle_rx_interrupt();
+}
+
+ISR(USART_UDRE_vect)
+{
+  FingerprintUart::handle_udre_interrupt();
+}
+
+//
+// Constructor
+//
+FingerprintUart::FingerprintUart() :
+  _receive_buffer_tail(0),
+  _receive_buffer_head(0),
+  _transmit_buffer_tail(0),
+  _transmit_buffer_head(0),
+  _buffer_overflow(false),
+  _receive_framing_errors(0),
+  _written(false)
+{
+}
+
+//
+// Destructor
+//
+FingerprintUart::~FingerprintUart()
+{
+  end();
+}
+
+//
+// Public methods
+//
+
+void FingerprintUart::begin(long speed)
+{
+  // let the bytes queued at the old rate go out first
+  flush();
+
+  // double speed mode halves the baud rate error at the rates the sensor uses
+  uint16_t baud_setting = (F_CPU / 4 / speed - 1) / 2;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  UCSR0B = 0;
+  UCSR0A = _BV(U2X0) | _BV(TXC0);
+  UBRR0 = baud_setting;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00); // 8N1
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0);
+  SREG = oldSREG;
+
+  active_object = NULL;
+  listen();
+}
+
+// This function sets the current object as the "listening"
+// one and returns true if it wasn't already
+bool FingerprintUart::listen()
+{
+  if (active_object == this)
+    return false;
+
+  _buffer_overflow = false;
+  _receive_buffer_head = _receive_buffer_tail = 0;
+  active_object = this;
+
+  setRxIntMsk(true);
+  return true;
+}
+
+// Stop listening. Returns true if we were actually listening.
+bool FingerprintUart::stopListening()
+{
+  if (active_object == this)
+  {
+    setRxIntMsk(false);
+    active_object = NULL;
+    return true;
+  }
+  return false;
+}
+
+void FingerprintUart::end()
+{
+  flush();
+  stopListening();
+  UCSR0B = 0;
+}
+
+// Read data from buffer
+int FingerprintUart::read()
+{
+  if (!isListening())
+    return -1;
+
+  // Empty buffer?
+  if (_receive_buffer_head == _receive_buffer_tail)
+    return -1;
+
+  // Read from "head"
+  uint8_t d = _receive_buffer[_receive_buffer_head]; // grab next byte
+  _receive_buffer_head = (_receive_buffer_head + 1) & _UART_RX_MASK;
+  return d;
+}
+
+int FingerprintUart::available()
+{
+  if (!isListening())
+    return 0;
+
+  return (_receive_buffer_tail - _receive_buffer_head) & _UART_RX_MASK;
+}
+
+int FingerprintUart::availableForWrite()
+{
+  return (_transmit_buffer_tail - _transmit_buffer_head - 1) & _UART_TX_MASK;
+}
+
+size_t FingerprintUart::write(uint8_t b)
+{
+  _written = true;
+
+  // straight into the data register when it's free and nothing is queued ahead
+  if ((_transmit_buffer_head == _transmit_buffer_tail) && bit_is_set(UCSR0A, UDRE0))
+  {
+    uint8_t oldSREG = SREG;
+    cli();
+    UDR0 = b;
+    UCSR0A = _BV(U2X0) | _BV(TXC0);
+    SREG = oldSREG;
+    return 1;
+  }
+
+  uint8_t next = (_transmit_buffer_head + 1) & _UART_TX_MASK;
+
+  // a full queue waits for the interrupt to make room, or drains it here if
+  // interrupts are disabled
+  while (next == _transmit_buffer_tail)
+  {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(UCSR0A, UDRE0))
+      handle_udre_interrupt();
+  }
+
+  _transmit_buffer[_transmit_buffer_head] = b;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  _transmit_buffer_head = next;
+  UCSR0B |= _BV(UDRIE0);
+  SREG = oldSREG;
+
+  return 1;
+}
+
+// Wait for the queued bytes to leave the shift register
+void FingerprintUart::flush()
+{
+  if (!_written)
+    return;
+
+  while (bit_is_set(UCSR0B, UDRIE0) || bit_is_clear(UCSR0A, TXC0))
+  {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(UCSR0B, UDRIE0) && bit_is_set(UCSR0A, UDRE0))
+      handle_udre_interrupt();
+  }
+  _written = false;
+}
+
+int FingerprintUart::peek()
+{
+  if (!isListening())
+    return -1;
+
+  // Empty buffer?
+  if (_receive_buffer_head == _receive_buffer_tail)
+    return -1;
+
+  // Read from "head"
+  return _receive_buffer[_receive_buffer_head];
+}
+
+// Points data at the oldest received byte and returns how many bytes follow
+// it without wrapping around the end of the buffer, 0 if there are none. The
+// bytes stay buffered until consume() releases them
+uint8_t FingerprintUart::peekContiguous(const uint8_t **data)
+{
+  if (!isListening())
+    return 0;
+
+  uint8_t head = _receive_buffer_head;
+  uint8_t tail = _receive_buffer_tail;
+  *data = &_receive_buffer[head];
+
+  if (tail >= head)
+    return tail - head;
+  // up to the end of the buffer, the rest is returned by the next call
+  return _UART_MAX_RX_BUFF - head;
+}
+
+// Releases count bytes returned by peekContiguous()
+void FingerprintUart::consume(uint8_t count)
+{
+  _receive_buffer_head = (_receive_buffer_head + count) & _UART_RX_MASK;
+}
+
+// Bytes received without a stop bit, read with the receive interrupt held off
+uint16_t FingerprintUart::rxFramingErrors()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t errors = _receive_framing_errors;
+  SREG = oldSREG;
+  return errors;
+}
+
+#endif
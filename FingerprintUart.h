@@ -0,0 +1,87 @@
+/*
+Interrupt-driven hardware USART transport for the fingerprint sensor
+
+Implements the same interface as FingerprintSerial on the ATmega328P USART0
+(RX on pin 0, TX on pin 1). Received bytes are queued by the RX complete
+interrupt and transmitted bytes are drained by the data register empty
+interrupt, so neither direction holds the CPU or blocks other interrupts.
+
+The USART is also the one Arduino's Serial uses, so the two can't be linked
+into the same sketch. With FINGERPRINT_UART_TRANSPORT defined the sketch moves
+its debug output and host link to a FingerprintSerial port instead.
+*/
+
+#ifndef FINGERPRINT_UART_h
+#define FINGERPRINT_UART_h
+
+#include <inttypes.h>
+#include <Stream.h>
+
+/******************************************************************************
+* Definitions
+******************************************************************************/
+
+// Uncomment to wire the fingerprint sensor to the hardware USART (pins 0/1)
+//#define FINGERPRINT_UART_TRANSPORT
+
+// Buffer sizes, both must be powers of two
+#ifndef _UART_MAX_RX_BUFF
+#define _UART_MAX_RX_BUFF 64 // RX buffer size
+#endif
+#ifndef _UART_MAX_TX_BUFF
+#define _UART_MAX_TX_BUFF 32 // TX buffer size, holds a whole command packet
+#endif
+
+class FingerprintUart final : public Stream
+{
+private:
+  // per object data
+  uint8_t _receive_buffer[_UART_MAX_RX_BUFF];
+  volatile uint8_t _receive_buffer_tail;
+  volatile uint8_t _receive_buffer_head;
+  uint8_t _transmit_buffer[_UART_MAX_TX_BUFF];
+  volatile uint8_t _transmit_buffer_tail;
+  volatile uint8_t _transmit_buffer_head;
+
+  volatile uint8_t _buffer_overflow:1;
+  volatile uint16_t _receive_framing_errors; // bytes whose stop bit wasn't there
+  uint8_t _written:1; // a byte went out since the last flush
+
+  // static data
+  static FingerprintUart *active_object;
+
+  inline void setRxIntMsk(bool enable) __attribute__((__always_inline__));
+
+public:
+  // public methods
+  FingerprintUart();
+  ~FingerprintUart();
+  void begin(long speed);
+  bool listen();
+  void end();
+  bool isListening() { return this == active_object; }
+  bool stopListening();
+  bool overflow() { bool ret = _buffer_overflow; if (ret) _buffer_overflow = false; return ret; }
+  // bytes received without a stop bit, a link running too fast for the sensor
+  uint16_t rxFramingErrors();
+  int peek();
+  // zero-copy reads: the longest run of received bytes that doesn't wrap,
+  // and releasing bytes once they've been used
+  uint8_t peekContiguous(const uint8_t **data);
+  void consume(uint8_t count);
+
+  virtual size_t write(uint8_t byte);
+  virtual int read();
+  virtual int available();
+  virtual int availableForWrite();
+  virtual void flush();
+  operator bool() { return true; }
+
+  using Print::write;
+
+  // public only for easy access by interrupt handlers
+  static inline void handle_rx_interrupt() __attribute__((__always_inline__));
+  static inline void handle_udre_interrupt() __attribute__((__always_inline__));
+};
+
+#endif
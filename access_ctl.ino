@@ -42,7 +42,15 @@
 #include "access_ctl_buzzer.h"
 #include "AccessCtlOnboardStorage.h"
 #include "FingerprintSerial.h"
+#include "FingerprintUart.h"
 #include "Fingerprint.h"
+#include "FingerprintIndex.h"
+#include "AccessCtlHotUsers.h"
+#include "AccessCtlHostLink.h"
+#include "AccessCtlTemplateCache.h"
+#include "AccessCtlSensorHealth.h"
+
+#include <util/atomic.h>
 
 //#define DEBUG_MAIN
 //#define DEBUG_KEYPAD
@@ -50,6 +58,7 @@
 //#define DEBUG_CONTACT
 //#define DEBUG_EXIT
 //#define DEBUG_DISPLAY
+//#define BENCH_FINGERPRINT_RX // times the packet parser over received templates once the sensor is up
 
 AccessCtlDisplay access_display;
 AccessCtlKeypad access_keypad;
@@ -59,59 +68,287 @@ AccessCtlExitBtn exitTrigger;
 AccessCtlBuzzer access_buzzer;
 AccessCtlOnboardStorage storage;
 
-FingerprintSerial fingerprintSerial(8, 9);
-Fingerprint fingerprintSensor = Fingerprint(&fingerprintSerial);
+#ifdef FINGERPRINT_UART_TRANSPORT
+// the sensor takes the hardware USART (pins 0/1), the debug output and host link move to pins 8/9
+FingerprintUart fingerprintSerial;
+Fingerprint<FingerprintUart> fingerprintSensor(&fingerprintSerial);
+FingerprintSerial debugSerial(8, 9);
+#else
+FingerprintSensorSerial fingerprintSerial(8, 9);
+Fingerprint<FingerprintSensorSerial> fingerprintSensor(&fingerprintSerial);
+HardwareSerial &debugSerial = Serial;
+#endif
 
 volatile bool validateFinger = false;
 volatile bool enrollFinger = false;
 
-// Holds the current number of templates saved, 
-// helps in allocating new IDs for new templates
-uint8_t FINGERPRINT_COUNT = 0;
-uint8_t currentFingerprintIndex = 0;
+// Occupancy of the sensor template library,
+// allocates IDs for new templates and bounds the searches
+FingerprintIndex fingerprintIndex;
+// Hit counters and the hot-tier slot map of the fingerprint users
+AccessCtlHotUsers hotUsers;
+// Management link to the host holding the full template database
+AccessCtlHostLink hostLink;
+// Recency of the sensor library locations, picks the template evicted for one fetched from the host
+AccessCtlTemplateCache templateCache;
+uint16_t currentFingerprintIndex = 0;
 char currentPIN[5];
 
 char pinInputBuffer[5];
 char pinChangeBuffer[5];
 
+// User ID keyed-in on the default screen, selects a 1:1 check for the next touch
+char userIdBuffer[5];
+volatile uint8_t userIdChars = 0;
+volatile unsigned long userIdMillis = 0;
+
 unsigned long longPressMillis = millis();
 unsigned long doorTimeoutMillis = millis();
-unsigned long getFingerprintDebounceMillis = millis();
+
+/**
+ * Enumeration defining the steps of the non-blocking fingerprint verification
+ */
+typedef enum VERIFY_STEPS : uint8_t
+{
+  VERIFY_IDLE,    /*< No verification in progress */
+  VERIFY_CAPTURE, /*< Image capture command in flight, repeated until the finger has settled */
+  VERIFY_CONVERT, /*< Image to feature template conversion in flight */
+  VERIFY_HOT_SEARCH,  /*< High-speed search of the hot tier in flight */
+  VERIFY_FAST_SEARCH, /*< High-speed library search in flight */
+  VERIFY_FULL_SEARCH, /*< Full library search in flight */
+  VERIFY_LOAD_MODEL,  /*< Loading the keyed-in user's template into slot 2 */
+  VERIFY_MATCH_MODEL, /*< 1:1 match of slot 1 against slot 2 in flight */
+  VERIFY_RECAPTURE,   /*< Second chance: image capture in flight, finger kept on the sensor */
+  VERIFY_RECONVERT,   /*< Second chance: image to feature template conversion in flight */
+  VERIFY_RETRY_SEARCH,/*< Second chance: library search of slot 2 in flight */
+  VERIFY_HOST_UPLOAD, /*< Features streaming from the sensor to the host */
+  VERIFY_HOST_LOOKUP, /*< Features sent to the host, waiting for its answer and template */
+  VERIFY_HOST_DOWNLOAD, /*< Downloading the host's template into the buffer the features aren't in */
+  VERIFY_HOST_MATCH,  /*< 1:1 match of the host's template against the features in flight */
+  VERIFY_HOST_EVICT,  /*< Deleting the least recently used template to make room for the host's */
+  VERIFY_HOST_STORE   /*< Storing the template downloaded from the host */
+} VerifySteps_t;
+
+/**
+ * Enumeration defining the steps of the non-blocking fingerprint registration
+ * The first touch only captures and converts into slot 1, the second one also builds, checks and stores the model
+ */
+typedef enum ENROLL_STEPS : uint8_t
+{
+  ENROLL_IDLE,      /*< No registration step in progress */
+  ENROLL_CAPTURE,   /*< Image capture command in flight, repeated until the finger has settled */
+  ENROLL_CONVERT,   /*< Image to feature template conversion in flight */
+  ENROLL_MODEL,     /*< Combining both feature templates into a model */
+  ENROLL_DUPLICATE, /*< Library search for the new model in flight, the same finger isn't registered twice */
+  ENROLL_STORE      /*< Storing the model at the lowest free location */
+} EnrollSteps_t;
+
+/**
+ * Enumeration defining the steps of a non-blocking template library index reload
+ */
+typedef enum INDEX_RELOAD_STEPS : uint8_t
+{
+  RELOAD_IDLE,  /*< No reload in progress */
+  RELOAD_TABLE, /*< Reading the index table pages */
+  RELOAD_COUNT  /*< Reading the template count, the sensor has no index table */
+} IndexReloadSteps_t;
+
+/**
+ * Enumeration defining the outcome of a fingerprint verification step
+ */
+typedef enum VERIFY_RESULT : uint8_t
+{
+  VERIFY_PENDING, /*< Verification still in progress */
+  VERIFY_MATCH,   /*< Record found */
+  VERIFY_NO_MATCH /*< Record not found, or error reading fingerprint */
+} VerifyResult_t;
+
+/**
+ * Enumeration defining what follows an image capture attempt
+ */
+typedef enum CAPTURE_OUTCOME : uint8_t
+{
+  CAPTURE_DONE,   /*< Image captured */
+  CAPTURE_RETRY,  /*< Finger not settled yet, capture again */
+  CAPTURE_FAILED  /*< Capture error, finger lifted or latency budget used up */
+} CaptureOutcome_t;
+
+/**
+ * Enumeration defining the available fingerprint search strategies
+ */
+typedef enum SEARCH_STRATEGY : uint8_t
+{
+  SEARCH_FULL,          /*< Full search over the occupied range only */
+  SEARCH_FAST_THEN_FULL /*< High-speed search first, full search over the occupied range as fallback */
+} SearchStrategy_t;
+
+/**
+ * Outcome counters of the fingerprint search tiers
+ */
+typedef struct SEARCH_STATS
+{
+  uint16_t hotHits;            /*< Matches found in the hot tier */
+  uint16_t fastHits;           /*< Matches found by the high-speed search */
+  uint16_t fullHits;           /*< Matches found by the full search fallback */
+  uint16_t idHits;             /*< Matches found by a 1:1 check against a keyed-in user ID */
+  uint16_t hostHits;           /*< Matches found by the host after the sensor library missed */
+  uint16_t misses;             /*< Verifications where no tier found a match */
+  uint16_t errors;             /*< Searches that failed on a communication error */
+  unsigned long lastLatencyMs; /*< Touch-to-result time of the last verification */
+} SearchStats_t;
+
+VerifySteps_t verifyStep = VERIFY_IDLE;
+unsigned long verifyStartMillis = 0;
+uint16_t verifyUserId = FINGERPRINT_INDEX_NONE;
+bool verifySecondChance = false;        // the second chance of this touch was taken
+bool verifyModelLoaded = false;         // slot 2 holds the keyed-in user's template
+unsigned long secondChanceMillis = 0;   // time the second chance started
+uint16_t searchFrom = 0;  // first page of the full library search
+uint16_t searchPages = 0; // page count of the full library search
+uint16_t hostLocation = FINGERPRINT_INDEX_NONE; // library location receiving the host's template
+uint8_t hostSlot = 2; // sensor buffer receiving the host's template, the other one holds the features
+
+EnrollSteps_t enrollStep = ENROLL_IDLE;
+unsigned long enrollStartMillis = 0;
+uint8_t enrollSlot = 1;                    // sensor buffer the touch being registered is converted into
+uint16_t enrollId = FINGERPRINT_INDEX_NONE; // library location the new model is stored at
+
+IndexReloadSteps_t reloadStep = RELOAD_IDLE;
+
+/**
+ * Enumeration defining the steps of a hot-tier template exchange
+ * Steps whose template location is empty are skipped. Every store is followed by a load or the delete, so an
+ * exchange resumed after its last acknowledged store never depends on what the sensor buffers held
+ */
+typedef enum COMPACT_STEPS : uint8_t
+{
+  COMPACT_IDLE,         /*< No exchange in progress */
+  COMPACT_LOAD_HOT,     /*< Loading the hot slot template into slot 1 */
+  COMPACT_STORE_SCRATCH,/*< Storing slot 1 into the scratch location, when both locations are used */
+  COMPACT_LOAD_OTHER,   /*< Loading the other template into slot 2 */
+  COMPACT_STORE_HOT,    /*< Storing slot 2 into the hot slot */
+  COMPACT_LOAD_SCRATCH, /*< Loading the hot slot template back into slot 1 from the scratch location */
+  COMPACT_STORE_OTHER,  /*< Storing slot 1 into the other location */
+  COMPACT_DELETE,       /*< Deleting the scratch copy, or the template left behind when only one location was used */
+  COMPACT_DONE          /*< Exchange complete */
+} CompactSteps_t;
+
+CompactSteps_t compactStep = COMPACT_IDLE;
+HotUserSwap_t compactSwap;   // the exchange in progress, persisted as the sensor acknowledges its stores
+bool compactResume = false;  // the exchange runs again from its last acknowledged store once the sensor is up
+uint8_t compactRetries = 0;
+uint16_t compactErrors = 0;
+
+SearchStrategy_t searchStrategy = SEARCH_FAST_THEN_FULL;
+SearchStats_t searchStats;
+
+/**
+ * Counters of the adaptive image capture
+ */
+typedef struct CAPTURE_STATS
+{
+  uint16_t captures;          /*< Images captured */
+  uint16_t retries;           /*< Capture attempts repeated because the finger hadn't settled */
+  uint16_t timeouts;          /*< Captures abandoned when the latency budget ran out */
+  unsigned long lastSettleMs; /*< Touch-to-image time of the last capture */
+  unsigned long maxSettleMs;  /*< Longest touch-to-image time seen */
+} CaptureStats_t;
+
+// Time a capture may keep retrying for a settled image after the touch
+uint16_t captureBudgetMs = 1000;
+CaptureStats_t captureStats;
+
+/**
+ * Counters of the second-chance matching (recapture without lifting the finger)
+ */
+typedef struct RETRY_STATS
+{
+  uint16_t attempts;             /*< Second chances taken */
+  uint16_t recoveries;           /*< Second chances that found a match */
+  unsigned long lastRetryCostMs; /*< Time the last successful second chance added to the verification */
+} RetryStats_t;
+
+RetryStats_t retryStats;
+
+/**
+ * Enumeration defining the steps of the non-blocking fingerprint sensor bring-up
+ */
+typedef enum BRINGUP_STEPS : uint8_t
+{
+  BRINGUP_IDLE,       /*< No bring-up in progress */
+  BRINGUP_PARAMETERS, /*< Reading the sensor capacity and packet length */
+  BRINGUP_LINK,       /*< Raising the link to the fast baud rate */
+  BRINGUP_INDEX,      /*< Reading the index table of the template library */
+  BRINGUP_COUNT,      /*< Reading the template count, the sensor has no index table */
+  BRINGUP_LED         /*< Setting the LED effect */
+} BringUpSteps_t;
+
+// The system runs PIN-only until the fingerprint sensor answers the background probe
+bool fingerprintReady = false;
+BringUpSteps_t bringUpStep = BRINGUP_IDLE;
+uint8_t bringUpRetries = 0; // parameter reads repeated, a sensor that won't answer is probed for again
+uint8_t bringUpMaxRetries = 3;
+unsigned long sensorReadyMs = 0; // time from reset until the sensor answered
+uint16_t cachedTemplateCount = 0xFFFF; // template count saved in the EEPROM, 0xFFFF if unknown
+
+// Fastest sensor link negotiated at boot, FingerprintSerial holds up to 115200 at 16 MHz
+uint32_t fingerprintFastBaud = 115200;
+// A raised link that shows this many receive errors within one check period falls back to the boot rate
+uint16_t linkMaxErrors = 3;
+uint16_t linkCheckMs = 10000;
+unsigned long linkCheckMillis = 0;
+uint16_t linkErrorsSeen = 0; // receive errors counted at the last check
+bool linkFallbackPending = false; // the link is being dropped back to the boot rate
+
+bool ledRequested = false; // the LED effect is to be restored once the sensor is free
+bool ledPending = false;   // the LED command is in flight
+
+#ifdef BENCH_FINGERPRINT_RX
+#define RX_BENCH_TEMPLATES 16 // template uploads timed per benchmark run
+#define RX_BENCH_GAP_US 2000  // pause between command loop calls, a busy main loop lets the received bytes pile up
+bool rxBenchDone = false;
+uint32_t rxBenchBytes = 0; // template bytes the uploads delivered
+#endif
+
+// Latency and error averages of the sensor, an unhealthy sensor is re-initialised through the background probe
+AccessCtlSensorHealth sensorHealth;
+bool healthPingPending = false;
+unsigned long healthPingMillis = 0;
 
 void setup()
 {
-  Serial.begin(57600);
+  debugSerial.begin(57600);
   
   memset(currentPIN, '\0', sizeof(currentPIN));
   storage.getPIN(currentPIN); // retrieve pin into currentPIN variable
-  
-  // Set baud rate for the fingerprint sensor serial port
-  fingerprintSensor.begin(57600);
 
-  // verify that the fingerprint sensor is connected correctly
-  while (!fingerprintSensor.verifyPassword())
+  clearUserId();
+  access_display.setUserIdInput(userIdBuffer);
+
+  // restore the hot-tier slot map, an exchange cut short by a power loss is finished once the sensor is up
+  hotUsers.begin(&storage);
+  if (hotUsers.pendingSwap(&compactSwap))
   {
-    #ifdef DEBUG_FINGERPRINT
-      Serial.println("Fingerprint sensor not found!");
-    #endif
+    if ((compactSwap.step < COMPACT_LOAD_HOT) || (compactSwap.step > COMPACT_DONE)) compactSwap.step = COMPACT_LOAD_HOT;
+    compactStep = COMPACT_LOAD_HOT;
+    compactResume = true;
   }
+  templateCache.begin(&fingerprintIndex, &hotUsers);
+  hostLink.begin(&debugSerial);
   
-  #ifdef DEBUG_FINGERPRINT
-    Serial.println("Fingerprint sensor found!");
-  #endif
-  
-  // get the current number of templates saved on the fingerprint sensor
-  fingerprintSensor.getTemplateCount();
-  FINGERPRINT_COUNT = fingerprintSensor.templateCount;
+  // the template count known when the sensor was last up
+  cachedTemplateCount = storage.getTemplateCount();
 
-  #ifdef DEBUG_FINGERPRINTuint8_t
-    Serial.print("Fingerprint templates: ");
-    Serial.println(FINGERPRINT_COUNT);
+  // Set baud rate for the fingerprint sensor serial port
+  // the sensor is looked for in the background, see fingerprintProbeLoop()
+  fingerprintSensor.begin(57600);
+  #ifdef FINGERPRINT_DEBUG
+  // the packet traces go out with the rest of the debug output
+  fingerprintSensor.setDebugPort(&debugSerial);
   #endif
 
   // For fingerprint sensor touch detection
   setupFingerprintTouch();
-  fingeprintLEDOn();
 
   // attach callbacks
 //  fingerprintSensor.attachTouchCallback(fingerprintSensorTouchCallback);
@@ -122,20 +359,214 @@ void setup()
   sei();
 }
 
+/**
+ * @brief	 Probes for the fingerprint sensor until it answers, without holding up the rest of the system
+ *          The sensor is polled as it boots, and the other baud rates are scanned in case it was left at one
+ *          of them. Fingerprint mode is enabled once it answers and has been brought up
+ */
+void fingerprintProbeLoop(void)
+{
+  if (fingerprintReady) return;
+
+  if (bringUpStep != BRINGUP_IDLE)
+  {
+    fingerprintBringUpLoop();
+    return;
+  }
+
+  uint8_t status = fingerprintSensor.handshakeLoop();
+  if (status == FINGERPRINT_TIMEOUT) return;
+
+  if (status != FINGERPRINT_OK)
+  {
+    #ifdef DEBUG_FINGERPRINT
+      debugSerial.println("Fingerprint sensor password refused!");
+    #endif
+    return;
+  }
+
+  sensorReadyMs = millis();
+  
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.print("Fingerprint sensor found! Ready after (ms): ");
+    debugSerial.print(sensorReadyMs);
+    debugSerial.print(", baud: ");
+    debugSerial.println(fingerprintSensor.linkBaudRate());
+  #endif
+
+  // get the template capacity and packet length of the fingerprint sensor
+  // (the library defaults to a 64-template sensor otherwise), probed for again if it can't be asked
+  bringUpRetries = 0;
+  if (fingerprintSensor.getParametersAsync()) bringUpStep = BRINGUP_PARAMETERS;
+}
+
+/**
+ * @brief	 Configures the fingerprint sensor once it has answered, and loads its template library index
+ *          One sensor command per call, each step starts once the command engine has the previous one's
+ *          answer. Fingerprint mode is enabled after the last step
+ */
+void fingerprintBringUpLoop(void)
+{
+  if (fingerprintSensor.commandState() == FINGERPRINT_CMD_PENDING) return;
+
+  switch (bringUpStep)
+  {
+    case BRINGUP_PARAMETERS:
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+      {
+        // the capacity bounds the index, the searches and new enrollments, so fingerprint mode never
+        // starts on the library default; the template count saved in the EEPROM is kept as well
+        if ((++bringUpRetries <= bringUpMaxRetries) && fingerprintSensor.getParametersAsync()) return;
+
+        #ifdef DEBUG_FINGERPRINT
+          debugSerial.println("Fingerprint parameters not available");
+        #endif
+        bringUpStep = BRINGUP_IDLE;
+        return;
+      }
+
+      // raise the link for bulk template transfers, falls back by itself if the faster rate doesn't hold up
+      fingerprintSensor.beginNegotiateLink(fingerprintFastBaud, FINGERPRINT_PACKET_SIZE_128);
+      bringUpStep = BRINGUP_LINK;
+      break;
+
+    case BRINGUP_LINK:
+    {
+      uint8_t status = fingerprintSensor.negotiateLinkLoop();
+      if (status == FINGERPRINT_PENDING) return;
+
+      if (status != FINGERPRINT_OK)
+      {
+        #ifdef DEBUG_FINGERPRINT
+          debugSerial.println("Fingerprint link kept at the boot rate");
+        #endif
+      }
+      linkErrorsSeen = fingerprintSensor.rxErrors();
+      linkCheckMillis = millis();
+
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.print("Fingerprint link (baud): ");
+        debugSerial.println(fingerprintSensor.linkBaudRate());
+        debugSerial.print("Fingerprint capacity: ");
+        debugSerial.print(fingerprintSensor.capacity);
+        debugSerial.print(", packet length: ");
+        debugSerial.println(fingerprintSensor.packet_len);
+      #endif
+
+      // get the occupied template locations from the fingerprint sensor
+      fingerprintSensor.beginLoadIndex(&fingerprintIndex);
+      bringUpStep = BRINGUP_INDEX;
+      break;
+    }
+
+    case BRINGUP_INDEX:
+    {
+      uint8_t status = fingerprintSensor.loadIndexLoop();
+      if (status == FINGERPRINT_PENDING) return;
+
+      if (status == FINGERPRINT_OK)
+      {
+        fingerprintSensor.LEDcontrolAsync(FINGERPRINT_LED_BREATHING, 100, FINGERPRINT_LED_BLUE);
+        bringUpStep = BRINGUP_LED;
+        break;
+      }
+
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Fingerprint index table not available");
+      #endif
+
+      fingerprintIndex.begin(fingerprintSensor.capacity);
+      fingerprintSensor.getTemplateCountAsync();
+      bringUpStep = BRINGUP_COUNT;
+      break;
+    }
+
+    case BRINGUP_COUNT:
+      // a sensor too slow to answer falls back to the count saved when it was last up
+      if (fingerprintSensor.commandResult() == FINGERPRINT_OK) assumeTemplateCount(fingerprintSensor.templateCount);
+      else if (cachedTemplateCount != 0xFFFF) assumeTemplateCount(cachedTemplateCount);
+
+      fingerprintSensor.LEDcontrolAsync(FINGERPRINT_LED_BREATHING, 100, FINGERPRINT_LED_BLUE);
+      bringUpStep = BRINGUP_LED;
+      break;
+
+    case BRINGUP_LED:
+      // the LED command isn't sent if the effect already runs
+      if (fingerprintSensor.commandState() == FINGERPRINT_CMD_DONE) fingerprintSensor.commandResult();
+      finishBringUp();
+      break;
+
+    default:
+      bringUpStep = BRINGUP_IDLE;
+      break;
+  }
+}
+
+/**
+ * @brief	 Enables fingerprint mode once the sensor has been brought up
+ */
+void finishBringUp(void)
+{
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.print("Fingerprint templates: ");
+    debugSerial.println(fingerprintIndex.count());
+  #endif
+  saveTemplateCount();
+
+  // judge the sensor from here on, not by the probes that looked for it
+  sensorHealth.begin(fingerprintSensor.cmdCount, fingerprintSensor.cmdFailures);
+  healthPingMillis = millis();
+
+  bringUpStep = BRINGUP_IDLE;
+  fingerprintReady = true;
+}
+
+/**
+ * @brief	 Keeps the template count saved in the EEPROM up to date with the library index
+ */
+void saveTemplateCount(void)
+{
+  if (fingerprintIndex.count() == cachedTemplateCount) return;
+
+  cachedTemplateCount = fingerprintIndex.count();
+  storage.saveTemplateCount(cachedTemplateCount);
+}
+
 void loop()
 {
   #ifdef DEBUG_MAIN
-  Serial.println("Running...");
+  debugSerial.println("Running...");
   #endif
 
   // Display update loop
   access_display.displayLoop();
   // Buzzer update loop
   access_buzzer.buzzerLoop();
+  // Fingerprint command engine loop
+  fingerprintSensor.commandLoop();
+  // Fingerprint sensor background probe loop
+  fingerprintProbeLoop();
+  // Host management link loop
+  hostLink.linkLoop();
   // Fingerprint touch loop
   fingerprintTouchLoop();
+  // Keyed-in user ID loop
+  userIdLoop();
   // Fingerprint read loop
   validateFingerprintLoop();
+  // Hot-tier compaction loop
+  compactionLoop();
+  // Fingerprint link quality loop
+  fingerprintLinkLoop();
+  // Fingerprint sensor health loop
+  sensorHealthLoop();
+  // Template library index reload loop
+  reloadIndexLoop();
+  // Fingerprint LED loop
+  fingerprintLEDLoop();
+  #ifdef BENCH_FINGERPRINT_RX
+  fingerprintRxBench();
+  #endif
   // Enroll fingerprint loop
   enrollFingerprintLoop();
   // Solenoid lock loop
@@ -146,10 +577,37 @@ void loop()
 
 /**
  * @brief	 Enables the LED on the fingerprint sensor
+ *          The command is left to the LED loop, which sends it once the sensor is free
  */
 void fingeprintLEDOn(void)
 {
-  fingerprintSensor.LEDcontrol(FINGERPRINT_LED_BREATHING, 100, FINGERPRINT_LED_BLUE);
+  ledRequested = true;
+}
+
+/**
+ * @brief	 Executes the fingerprint LED loop
+ *          Sends a requested LED effect while nothing else uses the sensor, and collects its answer.
+ *          Nothing is sent if the effect already runs
+ */
+void fingerprintLEDLoop(void)
+{
+  if (ledPending)
+  {
+    uint8_t state = fingerprintSensor.commandState();
+    if (state == FINGERPRINT_CMD_PENDING) return;
+
+    if (state == FINGERPRINT_CMD_DONE) fingerprintSensor.commandResult();
+    ledPending = false;
+    return;
+  }
+
+  if (!ledRequested || !fingerprintReady || sensorBusy()) return;
+  if ((verifyStep != VERIFY_IDLE) || (enrollStep != ENROLL_IDLE)) return;
+  if (fingerprintSensor.commandState() != FINGERPRINT_CMD_IDLE) return;
+
+  ledRequested = false;
+  fingerprintSensor.LEDcontrolAsync(FINGERPRINT_LED_BREATHING, 100, FINGERPRINT_LED_BLUE);
+  ledPending = (fingerprintSensor.commandState() == FINGERPRINT_CMD_PENDING);
 }
 
 /**
@@ -160,6 +618,218 @@ void fingeprintLEDOff(void)
   
 }
 
+/**
+ * @brief	 Watches the raised fingerprint sensor link for framing errors
+ *          Framing errors, bad checksums and start code hunts are counted over each check period, and a link that
+ *          shows too many goes back to the boot rate. The check waits for the sensor to be idle, the switch runs one
+ *          sensor command per call
+ */
+void fingerprintLinkLoop(void)
+{
+  if (linkFallbackPending)
+  {
+    if (fingerprintSensor.fallbackLinkLoop() == FINGERPRINT_PENDING) return;
+
+    linkFallbackPending = false;
+    linkErrorsSeen = fingerprintSensor.rxErrors();
+    linkCheckMillis = millis();
+    return;
+  }
+
+  if (!fingerprintReady || !fingerprintSensor.linkRaised()) return;
+  if ((millis() - linkCheckMillis) < linkCheckMs) return;
+  if ((verifyStep != VERIFY_IDLE) || (enrollStep != ENROLL_IDLE) || sensorBusy()) return;
+  if (fingerprintSensor.commandState() != FINGERPRINT_CMD_IDLE) return;
+
+  uint16_t errors = fingerprintSensor.rxErrors();
+  uint16_t recent = errors - linkErrorsSeen;
+  linkErrorsSeen = errors;
+  linkCheckMillis = millis();
+
+  if (recent < linkMaxErrors) return;
+
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.print("Fingerprint link errors: "); debugSerial.println(recent);
+  #endif
+
+  linkFallbackPending = fingerprintSensor.beginFallbackLink();
+}
+
+/**
+ * @brief	 Pings the idle fingerprint sensor and keeps the averages of its latency and error rate
+ *          Every completed command counts towards the error rate, the pings measure latency. A sensor whose
+ *          averages pass the thresholds is re-initialised: fingerprint mode is suspended and the background
+ *          probe handshakes with it again, at whichever baud rate it answers
+ */
+void sensorHealthLoop(void)
+{
+  if (!fingerprintReady) return;
+
+  if (healthPingPending)
+  {
+    if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) return;
+
+    uint8_t result = fingerprintSensor.commandResult();
+    healthPingPending = false;
+    sensorHealth.recordCommands(fingerprintSensor.cmdCount, fingerprintSensor.cmdFailures);
+    sensorHealth.recordPing(result == FINGERPRINT_OK, fingerprintSensor.lastLatency);
+    reportSensorHealth();
+  }
+  else
+  {
+    sensorHealth.recordCommands(fingerprintSensor.cmdCount, fingerprintSensor.cmdFailures);
+  }
+
+  if (!sensorIdle() || (compactStep != COMPACT_IDLE)) return;
+
+  if (sensorHealth.unhealthy())
+  {
+    recoverSensor();
+    return;
+  }
+
+  if ((millis() - healthPingMillis) < SENSOR_HEALTH_PING_MS) return;
+
+  healthPingMillis = millis();
+  healthPingPending = fingerprintSensor.verifyPasswordAsync();
+}
+
+/**
+ * @brief	 Suspends fingerprint mode until the background probe finds the sensor again
+ *          The shadowed sensor state is dropped, the sensor may have restarted with other settings
+ */
+void recoverSensor(void)
+{
+  sensorHealth.recoveries++;
+
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.print("Fingerprint sensor unhealthy, latency (ms): ");
+    debugSerial.print(sensorHealth.latency());
+    debugSerial.print(", errors (%): ");
+    debugSerial.println(sensorHealth.errorPercent());
+  #endif
+  reportSensorHealth();
+
+  fingerprintSensor.invalidateShadow();
+  fingerprintReady = false;
+}
+
+/**
+ * @brief	 Reports the sensor health metrics on the debug port, and to the host if it is listening
+ */
+void reportSensorHealth(void)
+{
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.print("Fingerprint health, latency (ms): ");
+    debugSerial.print(sensorHealth.latency());
+    debugSerial.print(", errors (%): ");
+    debugSerial.print(sensorHealth.errorPercent());
+    debugSerial.print(", pings: ");
+    debugSerial.print(sensorHealth.pings);
+    debugSerial.print(", unanswered: ");
+    debugSerial.print(sensorHealth.pingFailures);
+    debugSerial.print(", recoveries: ");
+    debugSerial.println(sensorHealth.recoveries);
+    #if _SS_RX_STATS
+      debugSerial.print("Soft serial RX interrupt clocks per byte: ");
+      debugSerial.println(FingerprintSerial::rxIsrCyclesPerByte());
+    #endif
+    #ifndef FINGERPRINT_UART_TRANSPORT
+      debugSerial.print("Fingerprint RX buffer high water: ");
+      debugSerial.print(fingerprintSerial.rxHighWater());
+      debugSerial.print(" of ");
+      debugSerial.print(fingerprintSerial.rxBufferSize());
+      debugSerial.print(", overflows: ");
+      debugSerial.println(fingerprintSerial.rxOverflows());
+    #endif
+  #endif
+
+  if (!hostLink.online()) return;
+
+  uint16_t latency = sensorHealth.latency();
+  uint8_t health[] = {
+    (uint8_t)(latency >> 8), (uint8_t)latency,
+    sensorHealth.errorPercent(),
+    (uint8_t)(sensorHealth.pings >> 8), (uint8_t)sensorHealth.pings,
+    (uint8_t)(sensorHealth.pingFailures >> 8), (uint8_t)sensorHealth.pingFailures,
+    (uint8_t)(sensorHealth.recoveries >> 8), (uint8_t)sensorHealth.recoveries,
+    (uint8_t)(fingerprintSensor.linkBaudRate() / 9600)
+  };
+  hostLink.sendFrame(HOST_MSG_HEALTH, health, sizeof(health));
+}
+
+#ifdef BENCH_FINGERPRINT_RX
+/**
+ * @brief	 Sink of the receive benchmark, only counts the template bytes
+ * 
+ * @param data 
+ * @param length 
+ */
+void rxBenchSink(const uint8_t *data, uint16_t length)
+{
+  rxBenchBytes += length;
+}
+
+/**
+ * @brief	 Times the fingerprint command loop over received templates, once the sensor is up and idle
+ *          The first enrolled template is loaded into slot 1 and uploaded RX_BENCH_TEMPLATES times. Each command loop
+ *          call during the uploads is timed with Timer1, which the soft serial Timer1 modes run free at clk/1, and the
+ *          calls are spaced RX_BENCH_GAP_US apart so each one parses a batch of bytes. Build with FINGERPRINT_SPAN_READ
+ *          set to 1 and to 0 to compare the span reads with available()/read().
+ *          With _SS_RX_STATS set the receive interrupt clocks per byte over the run are printed as well.
+ *          Blocks for the whole run and shares the port with the host link, for benchmark builds only
+ */
+void fingerprintRxBench(void)
+{
+  if (rxBenchDone || !sensorIdle() || (fingerprintIndex.count() == 0)) return;
+  rxBenchDone = true;
+
+  if (fingerprintSensor.loadModel(fingerprintIndex.searchStart(), 1) != FINGERPRINT_OK)
+  {
+    debugSerial.println("RX bench: template load failed");
+    return;
+  }
+
+  uint32_t clocks = 0;
+  uint16_t uploads = 0;
+  rxBenchBytes = 0;
+  #if _SS_RX_STATS
+    uint32_t isrCycles = FingerprintSerial::rxIsrCycles;
+    uint32_t isrBytes = FingerprintSerial::rxIsrBytes;
+  #endif
+
+  for (uint8_t i = 0; i < RX_BENCH_TEMPLATES; i++)
+  {
+    if (!fingerprintSensor.uploadModelAsync(1, rxBenchSink)) break;
+    while (fingerprintSensor.commandState() == FINGERPRINT_CMD_PENDING)
+    {
+      delayMicroseconds(RX_BENCH_GAP_US);
+      uint16_t start = TCNT1;
+      fingerprintSensor.commandLoop();
+      clocks += (uint16_t)(TCNT1 - start);
+    }
+    if (fingerprintSensor.commandResult() == FINGERPRINT_OK) uploads++;
+  }
+
+  debugSerial.print("RX bench, span reads: "); debugSerial.print(FINGERPRINT_SPAN_READ ? "on" : "off");
+  debugSerial.print(", baud: "); debugSerial.print(fingerprintSensor.linkBaudRate());
+  debugSerial.print(", packet length: "); debugSerial.println(fingerprintSensor.packet_len);
+  debugSerial.print("Templates: "); debugSerial.print(uploads);
+  debugSerial.print(", bytes: "); debugSerial.print(rxBenchBytes);
+  debugSerial.print(", command loop clocks: "); debugSerial.print(clocks);
+  debugSerial.print(", per byte: "); debugSerial.println(rxBenchBytes ? clocks / rxBenchBytes : 0);
+  #if _SS_RX_STATS
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      isrCycles = FingerprintSerial::rxIsrCycles - isrCycles;
+      isrBytes = FingerprintSerial::rxIsrBytes - isrBytes;
+    }
+    debugSerial.print("RX interrupt clocks: "); debugSerial.print(isrCycles);
+    debugSerial.print(", per byte: "); debugSerial.println(isrBytes ? isrCycles / isrBytes : 0);
+  #endif
+}
+#endif
+
 /**
  * @brief	 Sets up the fingerprint sensor touch pin
  *          The pin is active low, and a low-level indicates that a finger has been placed over the sensor
@@ -176,10 +846,13 @@ void setupFingerprintTouch(void)
  */
 void fingerprintTouchLoop(void)
 {  
+  // PIN-only operation until the sensor answers
+  if (!fingerprintReady) return;
+
   if (bit_is_clear(PINB, PINB2))
   {
     #ifdef DEBUG_FINGERPRINT
-      Serial.println("Finger placed");
+      debugSerial.println("Finger placed");
     #endif
     
     switch (access_display.getCurrentScreen())
@@ -199,7 +872,7 @@ void fingerprintTouchLoop(void)
   else if (bit_is_set(PINB, PINB2))
   {
     #ifdef DEBUG_FINGERPRINT
-      Serial.println("Finger not present");
+      debugSerial.println("Finger not present");
     #endif
     
     if (access_display.getEnrollFingerStep() == REMOVE_FINGER_PROMPT)
@@ -213,168 +886,1084 @@ void fingerprintTouchLoop(void)
  * @brief	 Executes the exit button loop
  *          If the button is activated (active-low) a buzzer-alert is issued and the solenoid lock is energized
  */
-void exitLoop(void)
+void exitLoop(void)
+{
+  if (exitTrigger.isActivated())
+  {
+    #ifdef DEBUG_EXIT
+      debugSerial.println("Exit button pressed");
+    #endif
+    
+    unsigned long exitTriggerTiming = millis();
+    while ((millis() - exitTriggerTiming) < 500);
+
+    while (exitTrigger.isActivated());
+    
+    #ifdef DEBUG_EXIT
+      debugSerial.println("Exit activated!");
+    #endif
+    
+    access_buzzer.alert(ONE_BEEP, LONG_BEEP);
+    access_lock.openLock();
+    doorTimeoutMillis = millis();
+  }
+}
+
+/**
+ * @brief	 Executes the solenoid lock loop
+ *          Times out the solenoid lock and de-energizes the lock when the timeout has elapsed
+ *          Ensures that the lock is de-energized (locked) unless a fingerprint verification is done
+ */
+void lockLoop(void)
+{
+  if (access_lock.isOpened() && contact_sensor.doorClosed())
+  {
+    if ((millis() - doorTimeoutMillis) > 10000)
+    {
+      access_lock.closeLock();
+    }
+  }
+  
+}
+
+/**
+ * @brief	 Executes the menu access loop (main menu access through security code)
+ */
+void validateMenuAccessLoop(void)
+{
+  if (access_keypad.getCurrentKeypadState() == DEFAULT_STATE)
+  {
+    // if potential menu access
+    // sound buzzer when wait time elapsed
+  }
+}
+
+/**
+ * @brief	 Executes the fingerprint loop
+ *          Validates the fingerprint (during positive-presence) and performs verification.
+ *          Issues buzzer alert and displays a status message depending on the results of the verification (positive/negative)
+ *          (Access granted/denied)
+ *          The verification runs in steps, so the rest of the main loop keeps running while the sensor works
+ */
+void validateFingerprintLoop(void)
+{
+  if (validateFinger)
+  {
+    // let background work finish first, it uses the same sensor
+    if (sensorBusy()) return;
+
+    VerifyResult_t result = getFingerprint();
+    if (result == VERIFY_PENDING) return;
+
+    if (result == VERIFY_MATCH)
+    {
+      hotUsers.recordHit(hotUsers.toUserId(fingerprintSensor.fingerID));
+      templateCache.touch(fingerprintSensor.fingerID);
+
+      // Fingerprint match found
+      // sound buzzer, open door
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Showing success screen");
+      #endif
+      access_display.setCurrentScreen(SUCCESS_SCREEN);
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Success buzzer alert");
+      #endif
+      access_buzzer.alert(ONE_BEEP, LONG_BEEP);
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Opening lock");
+      #endif
+      access_lock.openLock();
+      doorTimeoutMillis = millis();
+    }
+    else
+    {
+      access_display.setCurrentScreen(ERROR_SCREEN);
+      access_buzzer.alert(THREE_BEEPS, SHORT_BEEP);
+    }
+    saveTemplateCount();
+    fingeprintLEDOn();
+    validateFinger = false;
+  }
+  
+}
+
+/**
+ * @brief	 Executes the fingerprint registration loop
+ *          The registration runs in steps, so the rest of the main loop keeps running while the sensor works
+ */
+void enrollFingerprintLoop(void)
+{
+  if (enrollFinger)
+  {
+    // let background work finish first, it uses the same sensor
+    if (sensorBusy()) return;
+
+    if (!enrollFingerprint()) return;
+    saveTemplateCount();
+    fingeprintLEDOn();
+    enrollFinger = false;
+  }
+}
+
+/**
+ * @brief	Reads the fingerprint on the sensor, and performs verification
+ *          Executed within the fingerprint verification loop. Each call advances the verification by at most
+ *          one step and never waits on the sensor; the commands are completed by the fingerprint command loop
+ * 
+ * @return VERIFY_PENDING -> Verification in progress, call again
+ * @return VERIFY_MATCH -> Verification success. Record found
+ * @return VERIFY_NO_MATCH -> Verfication failed. Record not found, or error reading fingerprint
+ */
+VerifyResult_t getFingerprint(void)
+{
+  switch (verifyStep)
+  {
+    case VERIFY_IDLE:
+      // A user ID keyed-in before the touch selects a 1:1 check
+      verifyUserId = takeUserId();
+      verifyStartMillis = millis();
+      verifySecondChance = false;
+      verifyModelLoaded = false;
+
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Fingerprint image capture");
+      #endif
+      
+      // log image capture started
+      // capture straight away, the attempt is repeated until the finger has settled
+      if (!fingerprintSensor.getImageAsync()) return endVerify(VERIFY_NO_MATCH);
+      verifyStep = VERIFY_CAPTURE;
+      break;
+
+    case VERIFY_CAPTURE:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      
+      switch (captureOutcome(fingerprintSensor.commandResult(), verifyStartMillis))
+      {
+        case CAPTURE_RETRY:
+          if (!fingerprintSensor.getImageAsync()) return endVerify(VERIFY_NO_MATCH);
+          return VERIFY_PENDING;
+        case CAPTURE_FAILED:
+          // log image capture error
+          return endVerify(VERIFY_NO_MATCH);
+        default:
+          break;
+      }
+      // log image capture successful
+
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Fingerprint image capture success");
+        debugSerial.println("Fingerprint image conversion");
+      #endif
+      
+      // log image to feature template conversion started
+      if (!fingerprintSensor.image2TzAsync()) return endVerify(VERIFY_NO_MATCH);
+      verifyStep = VERIFY_CONVERT;
+      break;
+
+    case VERIFY_CONVERT:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      switch (fingerprintSensor.commandResult())
+      {
+        case FINGERPRINT_OK:
+          break;
+        case FINGERPRINT_IMAGEMESS:
+          // smudged or shifted, worth another image
+          return verifyMissed();
+        default:
+          //log image to feature template conversion error
+          return endVerify(VERIFY_NO_MATCH);
+      }
+      // log image to feature template conversion success
+
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Fingerprint image conversion success");
+        debugSerial.println("Fingerprint search");
+      #endif
+
+      // log fingerprint search started
+      if (verifyUserId != FINGERPRINT_INDEX_NONE) return startMatch();
+      return startSearch();
+
+    case VERIFY_HOT_SEARCH:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      switch (fingerprintSensor.commandResult())
+      {
+        case FINGERPRINT_OK:
+          #ifdef DEBUG_FINGERPRINT
+            debugSerial.println("Fingerprint hot tier match found");
+          #endif
+          searchStats.hotHits++;
+          return endVerify(VERIFY_MATCH);
+        case FINGERPRINT_NOTFOUND:
+          // the high-speed search of the rest of the library skips the hot tier, the full search covers it again
+          return startLibrarySearch(true);
+        default:
+          searchStats.errors++;
+          return startLibrarySearch(false);
+      }
+
+    case VERIFY_FAST_SEARCH:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      switch (fingerprintSensor.commandResult())
+      {
+        case FINGERPRINT_OK:
+          #ifdef DEBUG_FINGERPRINT
+            debugSerial.println("Fingerprint high-speed search match found");
+          #endif
+          searchStats.fastHits++;
+          return endVerify(VERIFY_MATCH);
+        case FINGERPRINT_NOTFOUND:
+          break;
+        default:
+          searchStats.errors++;
+          break;
+      }
+
+      // fall back to the full search over the whole occupied range
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Fingerprint full search");
+      #endif
+      if (!fingerprintSensor.fingerSearchAsync(1, searchFrom, searchPages)) return endVerify(VERIFY_NO_MATCH);
+      verifyStep = VERIFY_FULL_SEARCH;
+      break;
+
+    case VERIFY_FULL_SEARCH:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      switch (fingerprintSensor.commandResult())
+      {
+        case FINGERPRINT_OK:
+          // log fingerprint search success
+          #ifdef DEBUG_FINGERPRINT
+            debugSerial.println("Fingerprint search match found");
+          #endif
+          searchStats.fullHits++;
+          return endVerify(VERIFY_MATCH);
+        case FINGERPRINT_NOTFOUND:
+          return verifyMissed();
+        default:
+          // log fingerprint search error
+          searchStats.errors++;
+          break;
+      }
+      return endVerify(VERIFY_NO_MATCH);
+
+    case VERIFY_LOAD_MODEL:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+      {
+        searchStats.errors++;
+        return endVerify(VERIFY_NO_MATCH);
+      }
+      verifyModelLoaded = true;
+      if (!fingerprintSensor.fingerMatchAsync()) return endVerify(VERIFY_NO_MATCH);
+      verifyStep = VERIFY_MATCH_MODEL;
+      break;
+
+    case VERIFY_MATCH_MODEL:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      switch (fingerprintSensor.commandResult())
+      {
+        case FINGERPRINT_OK:
+          #ifdef DEBUG_FINGERPRINT
+            debugSerial.println("Fingerprint 1:1 match found");
+          #endif
+          fingerprintSensor.fingerID = hotUsers.toLocation(verifyUserId);
+          searchStats.idHits++;
+          return endVerify(VERIFY_MATCH);
+        case FINGERPRINT_NOMATCH:
+          return verifyMissed();
+        default:
+          searchStats.errors++;
+          break;
+      }
+      return endVerify(VERIFY_NO_MATCH);
+
+    case VERIFY_RECAPTURE:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+
+      switch (captureOutcome(fingerprintSensor.commandResult(), secondChanceMillis))
+      {
+        case CAPTURE_RETRY:
+          if (!fingerprintSensor.getImageAsync()) return endVerify(VERIFY_NO_MATCH);
+          return VERIFY_PENDING;
+        case CAPTURE_FAILED:
+          searchStats.misses++;
+          return endVerify(VERIFY_NO_MATCH);
+        default:
+          break;
+      }
+
+      // the 1:1 check keeps the user's template in slot 2, so the new image goes into slot 1
+      if (!fingerprintSensor.image2TzAsync((verifyUserId != FINGERPRINT_INDEX_NONE) ? 1 : 2)) return endVerify(VERIFY_NO_MATCH);
+      verifyStep = VERIFY_RECONVERT;
+      break;
+
+    case VERIFY_RECONVERT:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+      {
+        searchStats.misses++;
+        return endVerify(VERIFY_NO_MATCH);
+      }
+
+      if (verifyUserId != FINGERPRINT_INDEX_NONE)
+      {
+        // a smudged first image never got as far as loading the template
+        if (!verifyModelLoaded) return startMatch();
+
+        // slot 2 still holds the user's template, match the new features against it straight away
+        if (!fingerprintSensor.fingerMatchAsync()) return endVerify(VERIFY_NO_MATCH);
+        verifyStep = VERIFY_MATCH_MODEL;
+        break;
+      }
+
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Fingerprint second chance search");
+      #endif
+      if (!fingerprintSensor.fingerSearchAsync(2, fingerprintIndex.searchStart(), fingerprintIndex.searchCount())) return endVerify(VERIFY_NO_MATCH);
+      verifyStep = VERIFY_RETRY_SEARCH;
+      break;
+
+    case VERIFY_RETRY_SEARCH:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      switch (fingerprintSensor.commandResult())
+      {
+        case FINGERPRINT_OK:
+          #ifdef DEBUG_FINGERPRINT
+            debugSerial.println("Fingerprint second chance match found");
+          #endif
+          searchStats.fullHits++;
+          return endVerify(VERIFY_MATCH);
+        case FINGERPRINT_NOTFOUND:
+          return lookupMissed(2);
+        default:
+          searchStats.errors++;
+          break;
+      }
+      return endVerify(VERIFY_NO_MATCH);
+
+    case VERIFY_HOST_UPLOAD:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+      {
+        searchStats.errors++;
+        return endVerify(VERIFY_NO_MATCH);
+      }
+      hostLink.requestLookup();
+      verifyStep = VERIFY_HOST_LOOKUP;
+      break;
+
+    case VERIFY_HOST_LOOKUP:
+      switch (hostLink.lookup())
+      {
+        case HOST_LOOKUP_MATCH:
+          #ifdef DEBUG_FINGERPRINT
+            debugSerial.println("Fingerprint host match, checking its template");
+          #endif
+          // the host's word alone doesn't open the door, its template has to match the finger on the sensor
+          if (!fingerprintSensor.downloadModelAsync(hostSlot, hostTemplateSource, hostLink.templateLength())) return endVerify(VERIFY_NO_MATCH);
+          verifyStep = VERIFY_HOST_DOWNLOAD;
+          break;
+        case HOST_LOOKUP_NO_MATCH:
+          searchStats.misses++;
+          return endVerify(VERIFY_NO_MATCH);
+        case HOST_LOOKUP_FAILED:
+          searchStats.errors++;
+          return endVerify(VERIFY_NO_MATCH);
+        default:
+          break;
+      }
+      break;
+
+    case VERIFY_HOST_DOWNLOAD:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+      {
+        searchStats.errors++;
+        return endVerify(VERIFY_NO_MATCH);
+      }
+      if (!fingerprintSensor.fingerMatchAsync()) return endVerify(VERIFY_NO_MATCH);
+      verifyStep = VERIFY_HOST_MATCH;
+      break;
+
+    case VERIFY_HOST_MATCH:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      switch (fingerprintSensor.commandResult())
+      {
+        case FINGERPRINT_OK:
+          #ifdef DEBUG_FINGERPRINT
+            debugSerial.println("Fingerprint host template matches");
+          #endif
+          return fetchHostTemplate();
+        case FINGERPRINT_NOMATCH:
+          searchStats.misses++;
+          break;
+        default:
+          searchStats.errors++;
+          break;
+      }
+      return endVerify(VERIFY_NO_MATCH);
+
+    case VERIFY_HOST_EVICT:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+      {
+        searchStats.errors++;
+        return endVerify(VERIFY_NO_MATCH);
+      }
+      return storeHostTemplate();
+
+    case VERIFY_HOST_STORE:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+      {
+        searchStats.errors++;
+        return endVerify(VERIFY_NO_MATCH);
+      }
+      return endHostMatch();
+
+    default:
+      break;
+  }
+
+  return VERIFY_PENDING;
+}
+
+/**
+ * @brief	 Ends the fingerprint verification, ready for the next touch
+ * 
+ * @param result 
+ * @return VerifyResult_t -> the result passed in
+ */
+VerifyResult_t endVerify(VerifyResult_t result)
+{
+  verifyStep = VERIFY_IDLE;
+  searchStats.lastLatencyMs = millis() - verifyStartMillis;
+
+  if ((result == VERIFY_MATCH) && verifySecondChance)
+  {
+    retryStats.recoveries++;
+    retryStats.lastRetryCostMs = millis() - secondChanceMillis;
+  }
+
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.print("Verification took (ms): "); debugSerial.println(searchStats.lastLatencyMs);
+    debugSerial.print("Hot hits: "); debugSerial.print(searchStats.hotHits);
+    debugSerial.print(", fast hits: "); debugSerial.print(searchStats.fastHits);
+    debugSerial.print(", full hits: "); debugSerial.print(searchStats.fullHits);
+    debugSerial.print(", 1:1 hits: "); debugSerial.print(searchStats.idHits);
+    debugSerial.print(", host hits: "); debugSerial.print(searchStats.hostHits);
+    debugSerial.print(", misses: "); debugSerial.print(searchStats.misses);
+    debugSerial.print(", errors: "); debugSerial.println(searchStats.errors);
+    debugSerial.print("Capture retries: "); debugSerial.print(captureStats.retries);
+    debugSerial.print(", timeouts: "); debugSerial.print(captureStats.timeouts);
+    debugSerial.print(", max settle (ms): "); debugSerial.println(captureStats.maxSettleMs);
+    debugSerial.print("Second chances: "); debugSerial.print(retryStats.attempts);
+    debugSerial.print(", recovered: "); debugSerial.print(retryStats.recoveries);
+    debugSerial.print(", last cost (ms): "); debugSerial.println(retryStats.lastRetryCostMs);
+    unsigned long saved = (unsigned long)fingerprintSensor.ledShadowHits + fingerprintSensor.paramShadowHits + fingerprintSensor.countShadowHits;
+    debugSerial.print("Round-trips saved, LED: "); debugSerial.print(fingerprintSensor.ledShadowHits);
+    debugSerial.print(", parameters: "); debugSerial.print(fingerprintSensor.paramShadowHits);
+    debugSerial.print(", count: "); debugSerial.print(fingerprintSensor.countShadowHits);
+    debugSerial.print(", per hour: "); debugSerial.println((saved * 3600UL) / ((millis() / 1000UL) + 1));
+  #endif
+  
+  return result;
+}
+
+/**
+ * @brief	 Starts reloading the occupancy index of the sensor template library
+ *          The reload runs in steps from the reload loop, see reloadIndexLoop()
+ */
+void reloadFingerprintIndex(void)
+{
+  if (!fingerprintSensor.beginLoadIndex(&fingerprintIndex)) return;
+  reloadStep = RELOAD_TABLE;
+}
+
+/**
+ * @brief	 Executes the template library index reload loop
+ *          One sensor command per call. Sensors without an index table are assumed to hold templates
+ *          1 - templateCount, the IDs this firmware used to hand out sequentially
+ */
+void reloadIndexLoop(void)
+{
+  if (reloadStep == RELOAD_IDLE) return;
+  if (fingerprintSensor.commandState() == FINGERPRINT_CMD_PENDING) return;
+
+  switch (reloadStep)
+  {
+    case RELOAD_TABLE:
+    {
+      uint8_t status = fingerprintSensor.loadIndexLoop();
+      if (status == FINGERPRINT_PENDING) return;
+
+      if (status == FINGERPRINT_OK)
+      {
+        reloadStep = RELOAD_IDLE;
+        return;
+      }
+
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Fingerprint index table not available");
+      #endif
+
+      fingerprintIndex.begin(fingerprintSensor.capacity);
+      reloadStep = fingerprintSensor.getTemplateCountAsync() ? RELOAD_COUNT : RELOAD_IDLE;
+      break;
+    }
+
+    case RELOAD_COUNT:
+      // a sensor too slow to answer falls back to the count saved when it was last up
+      if (fingerprintSensor.commandResult() == FINGERPRINT_OK) assumeTemplateCount(fingerprintSensor.templateCount);
+      else if (cachedTemplateCount != 0xFFFF) assumeTemplateCount(cachedTemplateCount);
+      reloadStep = RELOAD_IDLE;
+      break;
+
+    default:
+      reloadStep = RELOAD_IDLE;
+      break;
+  }
+}
+
+/**
+ * @brief	 Marks templates 1 - count as occupied, for sensors without an index table
+ * 
+ * @param count The number of templates in the sensor library
+ */
+void assumeTemplateCount(uint16_t count)
+{
+  for (uint16_t id = 1; id <= count; id++) fingerprintIndex.markUsed(id);
+  fingerprintSensor.attachIndex(&fingerprintIndex);
+}
+
+/**
+ * @brief	 Handles a fingerprint that wasn't recognised
+ *          While the finger is still on the sensor, takes one more image within the same touch instead of
+ *          making the user lift and retouch. A 1:N search of the new image runs from slot 2, leaving slot 1 intact
+ * 
+ * @return VERIFY_PENDING -> Second chance started
+ * @return VERIFY_NO_MATCH -> Second chance already taken, finger lifted, or the capture couldn't be started
+ */
+VerifyResult_t verifyMissed(void)
+{
+  if (verifySecondChance || bit_is_set(PINB, PINB2))
+  {
+    // the latest 1:N features are in slot 2 after a second chance
+    if (verifyUserId == FINGERPRINT_INDEX_NONE) return lookupMissed(verifySecondChance ? 2 : 1);
+    searchStats.misses++;
+    return endVerify(VERIFY_NO_MATCH);
+  }
+
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.println("Fingerprint second chance capture");
+  #endif
+
+  verifySecondChance = true;
+  secondChanceMillis = millis();
+  retryStats.attempts++;
+
+  if (!fingerprintSensor.getImageAsync()) return endVerify(VERIFY_NO_MATCH);
+  verifyStep = VERIFY_RECAPTURE;
+  return VERIFY_PENDING;
+}
+
+/**
+ * @brief	 Hands a fingerprint the sensor library doesn't hold to the host
+ *          The features are streamed to the host as the command loop receives them from the sensor, and the host's
+ *          answer is awaited by the verification steps. Without a host on the link the fingerprint is simply rejected
+ * 
+ * @param slot -> the sensor buffer holding the features
+ * @return VERIFY_PENDING -> Upload started
+ * @return VERIFY_NO_MATCH -> No host, or the upload couldn't be started
+ */
+VerifyResult_t lookupMissed(uint8_t slot)
+{
+  if (!hostLink.online())
+  {
+    searchStats.misses++;
+    return endVerify(VERIFY_NO_MATCH);
+  }
+
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.println("Fingerprint host lookup");
+  #endif
+
+  hostLink.beginLookup();
+  if (!fingerprintSensor.uploadModelAsync(slot, hostFeatureSink)) return endVerify(VERIFY_NO_MATCH);
+
+  // the host's template goes into the other buffer, to be matched against these features
+  hostSlot = (slot == 1) ? 2 : 1;
+  verifyStep = VERIFY_HOST_UPLOAD;
+  return VERIFY_PENDING;
+}
+
+/**
+ * @brief	 Makes room in the sensor library for the host's template, once it has matched the finger
+ *          A free location is used if there is one, otherwise the least recently used template is deleted
+ * 
+ * @return VERIFY_PENDING -> Eviction or store started
+ * @return VERIFY_NO_MATCH -> No location can take the template, or the eviction couldn't be started
+ */
+VerifyResult_t fetchHostTemplate(void)
+{
+  bool evict = false;
+
+  hostLocation = templateCache.victim(&evict);
+  if (hostLocation == FINGERPRINT_INDEX_NONE)
+  {
+    searchStats.errors++;
+    return endVerify(VERIFY_NO_MATCH);
+  }
+
+  if (!evict) return storeHostTemplate();
+
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.print("Evicting template: ");
+    debugSerial.println(hostLocation);
+  #endif
+
+  if (!fingerprintSensor.deleteModelAsync(hostLocation)) return endVerify(VERIFY_NO_MATCH);
+  verifyStep = VERIFY_HOST_EVICT;
+  return VERIFY_PENDING;
+}
+
+/**
+ * @brief	 Starts storing the host's template, already in the sensor buffer, at the location picked for it
+ * 
+ * @return VERIFY_PENDING -> Store started
+ * @return VERIFY_NO_MATCH -> The store couldn't be started
+ */
+VerifyResult_t storeHostTemplate(void)
+{
+  if (!fingerprintSensor.storeModelAsync(hostLocation, hostSlot)) return endVerify(VERIFY_NO_MATCH);
+
+  verifyStep = VERIFY_HOST_STORE;
+  return VERIFY_PENDING;
+}
+
+/**
+ * @brief	 Ends a verification the host matched, its template checked against the finger and cached
+ * 
+ * @return VERIFY_MATCH
+ */
+VerifyResult_t endHostMatch(void)
+{
+  searchStats.hostHits++;
+  fingerprintSensor.fingerID = hostLocation;
+  return endVerify(VERIFY_MATCH);
+}
+
+/**
+ * @brief	 Fingerprint sensor sink, forwards the uploaded features to the host
+ * 
+ * @param data 
+ * @param length 
+ */
+void hostFeatureSink(const uint8_t *data, uint16_t length)
+{
+  hostLink.sendFeatures(data, length);
+}
+
+/**
+ * @brief	 Fingerprint sensor source, provides the template pulled from the host
+ * 
+ * @param data 
+ * @param length 
+ * @return uint16_t -> bytes provided
+ */
+uint16_t hostTemplateSource(uint8_t *data, uint16_t length)
+{
+  uint16_t read = hostLink.readTemplate(data, length);
+
+  return (read == HOST_LINK_READ_FAILED) ? FINGERPRINT_SOURCE_FAILED : read;
+}
+
+/**
+ * @brief	 Decides what follows an image capture attempt
+ *          A finger that hasn't settled yet reads as no finger or a failed image, so the capture is repeated
+ *          while the finger is still on the sensor and the latency budget allows
+ * 
+ * @param result -> confirmation code of getImage()
+ * @param touchMillis -> time the touch was detected
+ * @return CaptureOutcome_t 
+ */
+CaptureOutcome_t captureOutcome(uint8_t result, unsigned long touchMillis)
+{
+  unsigned long elapsed = millis() - touchMillis;
+
+  if (result == FINGERPRINT_OK)
+  {
+    captureStats.captures++;
+    captureStats.lastSettleMs = elapsed;
+    if (elapsed > captureStats.maxSettleMs) captureStats.maxSettleMs = elapsed;
+
+    #ifdef DEBUG_FINGERPRINT
+      debugSerial.print("Fingerprint settled after (ms): "); debugSerial.println(elapsed);
+    #endif
+    
+    return CAPTURE_DONE;
+  }
+
+  if ((result != FINGERPRINT_NOFINGER) && (result != FINGERPRINT_IMAGEFAIL)) return CAPTURE_FAILED;
+  if (bit_is_set(PINB, PINB2)) return CAPTURE_FAILED; // finger lifted
+
+  if (elapsed >= captureBudgetMs)
+  {
+    captureStats.timeouts++;
+    return CAPTURE_FAILED;
+  }
+
+  captureStats.retries++;
+  return CAPTURE_RETRY;
+}
+
+/**
+ * @brief	 Starts a 1:1 check of the captured fingerprint against the keyed-in user's template
+ *          Costs the same however many templates are enrolled
+ * 
+ * @return VERIFY_PENDING -> Check started
+ * @return VERIFY_NO_MATCH -> No template under that ID, or the check couldn't be started
+ */
+VerifyResult_t startMatch(void)
+{
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.print("Fingerprint 1:1 check, user ID: "); debugSerial.println(verifyUserId);
+  #endif
+
+  uint16_t location = hotUsers.toLocation(verifyUserId);
+  if (!fingerprintIndex.isUsed(location))
+  {
+    searchStats.misses++;
+    return endVerify(VERIFY_NO_MATCH);
+  }
+
+  if (!fingerprintSensor.loadModelAsync(location, 2)) return endVerify(VERIFY_NO_MATCH);
+  verifyStep = VERIFY_LOAD_MODEL;
+  return VERIFY_PENDING;
+}
+
+/**
+ * @brief	 Clears the keyed-in user ID
+ */
+void clearUserId(void)
+{
+  memset(userIdBuffer, '\0', sizeof(userIdBuffer));
+  userIdChars = 0;
+}
+
+/**
+ * @brief	 Adds a digit to the keyed-in user ID
+ *          Called from the keypad ISR
+ * 
+ * @param digit 
+ */
+void addUserIdDigit(char digit)
+{
+  if (userIdChars >= (sizeof(userIdBuffer) - 1)) return;
+  userIdBuffer[userIdChars++] = digit;
+  userIdMillis = millis();
+}
+
+/**
+ * @brief	 Consumes the keyed-in user ID
+ * 
+ * @return uint16_t -> the user ID, or FINGERPRINT_INDEX_NONE if none was keyed-in
+ */
+uint16_t takeUserId(void)
+{
+  uint16_t id = FINGERPRINT_INDEX_NONE;
+
+  // the keypad ISR writes the buffer
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (userIdChars > 0) id = atoi(userIdBuffer);
+    clearUserId();
+  }
+
+  return id;
+}
+
+/**
+ * @brief	 Executes the keyed-in user ID loop
+ *          Drops a user ID that was keyed-in but not followed by a touch, so it can't apply to the next person
+ */
+void userIdLoop(void)
+{
+  // the keypad ISR writes the ID and its time stamp
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if ((userIdChars > 0) && ((millis() - userIdMillis) > 10000)) clearUserId();
+  }
+}
+
+/**
+ * @brief	 Starts the fingerprint search, with the hot tier first when it holds any templates
+ *          Skips the search altogether when no templates are enrolled
+ * 
+ * @return VERIFY_PENDING -> Search started
+ * @return VERIFY_NO_MATCH -> Nothing to search, or the search couldn't be started
+ */
+VerifyResult_t startSearch(void)
 {
-  if (exitTrigger.isActivated())
+  if (fingerprintIndex.count() == 0)
   {
-    #ifdef DEBUG_EXIT
-      Serial.println("Exit button pressed");
-    #endif
-    
-    unsigned long exitTriggerTiming = millis();
-    while ((millis() - exitTriggerTiming) < 500);
+    searchStats.misses++;
+    return endVerify(VERIFY_NO_MATCH);
+  }
 
-    while (exitTrigger.isActivated());
-    
-    #ifdef DEBUG_EXIT
-      Serial.println("Exit activated!");
-    #endif
-    
-    access_buzzer.alert(ONE_BEEP, LONG_BEEP);
-    access_lock.openLock();
-    doorTimeoutMillis = millis();
+  for (uint16_t slot = 0; slot < HOT_USER_SLOTS; slot++)
+  {
+    if (!fingerprintIndex.isUsed(slot)) continue;
+
+    if (!fingerprintSensor.fingerFastSearchAsync(1, 0, HOT_USER_SLOTS)) return endVerify(VERIFY_NO_MATCH);
+    verifyStep = VERIFY_HOT_SEARCH;
+    return VERIFY_PENDING;
   }
+
+  return startLibrarySearch(false);
 }
 
 /**
- * @brief	 Executes the solenoid lock loop
- *          Times out the solenoid lock and de-energizes the lock when the timeout has elapsed
- *          Ensures that the lock is de-energized (locked) unless a fingerprint verification is done
+ * @brief	 Starts the first library search tier of the configured search strategy
+ *          The full search always covers the whole occupied range, hot tier included, as a high-speed search
+ *          can miss a finger the full one would find
+ * 
+ * @param skipHotTier -> the hot tier was already searched at high speed, the high-speed search covers the pages
+ *                       above it only
+ * @return VERIFY_PENDING -> Search started
+ * @return VERIFY_NO_MATCH -> Nothing to search, or the search couldn't be started
  */
-void lockLoop(void)
+VerifyResult_t startLibrarySearch(bool skipHotTier)
 {
-  if (access_lock.isOpened() && contact_sensor.doorClosed())
+  uint16_t end = fingerprintIndex.searchStart() + fingerprintIndex.searchCount();
+
+  searchFrom = fingerprintIndex.searchStart();
+  if (searchFrom >= end) return verifyMissed();
+  searchPages = end - searchFrom;
+
+  uint16_t fastFrom = searchFrom;
+  if (skipHotTier && (fastFrom < HOT_USER_SLOTS)) fastFrom = HOT_USER_SLOTS;
+
+  // with every template in the hot tier, go straight to the full search
+  if ((searchStrategy == SEARCH_FAST_THEN_FULL) && (fastFrom < end))
   {
-    if ((millis() - doorTimeoutMillis) > 10000)
-    {
-      access_lock.closeLock();
-    }
+    if (!fingerprintSensor.fingerFastSearchAsync(1, fastFrom, end - fastFrom)) return endVerify(VERIFY_NO_MATCH);
+    verifyStep = VERIFY_FAST_SEARCH;
+  }
+  else
+  {
+    if (!fingerprintSensor.fingerSearchAsync(1, searchFrom, searchPages)) return endVerify(VERIFY_NO_MATCH);
+    verifyStep = VERIFY_FULL_SEARCH;
   }
   
+  return VERIFY_PENDING;
 }
 
 /**
- * @brief	 Executes the menu access loop (main menu access through security code)
+ * @brief	 Checks whether background work holds the sensor
+ *          (a template exchange, health ping, link fallback, index reload or LED command)
+ * 
+ * @return true -> Other sensor work has to wait
+ * @return false -> No background work is in progress
  */
-void validateMenuAccessLoop(void)
+bool sensorBusy(void)
 {
-  if (access_keypad.getCurrentKeypadState() == DEFAULT_STATE)
-  {
-    // if potential menu access
-    // sound buzzer when wait time elapsed
-  }
+  if ((compactStep != COMPACT_IDLE) || (reloadStep != RELOAD_IDLE)) return true;
+  return healthPingPending || linkFallbackPending || ledPending;
 }
 
 /**
- * @brief	 Executes the fingerprint loop
- *          Validates the fingerprint (during positive-presence) and performs verification.
- *          Issues buzzer alert and displays a status message depending on the results of the verification (positive/negative)
- *          (Access granted/denied)
+ * @brief	 Checks whether the sensor is free for background work (template exchanges, health pings)
+ *          Only while idle on the default screen, with no finger on the sensor and no verification for a while
+ * 
+ * @return true -> Background work may run
+ * @return false -> The sensor is, or may soon be, in use
  */
-void validateFingerprintLoop(void)
+bool sensorIdle(void)
 {
-  if (validateFinger)
+  if (sensorBusy()) return false;
+  if (!fingerprintReady) return false;
+  if (validateFinger || enrollFinger || (verifyStep != VERIFY_IDLE)) return false;
+  if (access_display.getCurrentScreen() != DEFAULT_SCREEN) return false;
+  if (fingerprintSensor.commandState() != FINGERPRINT_CMD_IDLE) return false;
+  if (bit_is_clear(PINB, PINB2) || (userIdChars > 0)) return false;
+
+  return (millis() - verifyStartMillis) > 2000;
+}
+
+/**
+ * @brief	 Issues the command of the current template exchange step
+ *          Steps that don't apply to the exchange are skipped
+ * 
+ * @return true -> A command was issued, or the exchange is complete
+ * @return false -> The command couldn't be started
+ */
+bool issueCompactStep(void)
+{
+  bool hotUsed = compactSwap.flags & HOT_SWAP_HOT_USED;
+  bool otherUsed = compactSwap.flags & HOT_SWAP_OTHER_USED;
+  bool scratchUsed = compactSwap.scratch != HOT_USER_NONE;
+
+  while (true)
   {
-    // Wait for the finger to settle on the sensor
-    getFingerprintDebounceMillis = millis();
-    while ((millis() - getFingerprintDebounceMillis) < 500);
-    
-    if (getFingerprint())
-    {
-      // Fingerprint match found
-      // sound buzzer, open door
-      #ifdef DEBUG_FINGERPRINT
-        Serial.println("Showing success screen");
-      #endif
-      access_display.setCurrentScreen(SUCCESS_SCREEN);
-      #ifdef DEBUG_FINGERPRINT
-        Serial.println("Success buzzer alert");
-      #endif
-      access_buzzer.alert(ONE_BEEP, LONG_BEEP);
-      #ifdef DEBUG_FINGERPRINT
-        Serial.println("Opening lock");
-      #endif
-      access_lock.openLock();
-      doorTimeoutMillis = millis();
-    }
-    else
+    switch (compactStep)
     {
-      access_display.setCurrentScreen(ERROR_SCREEN);
-      access_buzzer.alert(THREE_BEEPS, SHORT_BEEP);
+      case COMPACT_LOAD_HOT:
+        if (hotUsed) return fingerprintSensor.loadModelAsync(compactSwap.hotSlot, 1);
+        break;
+      case COMPACT_STORE_SCRATCH:
+        if (scratchUsed) return fingerprintSensor.storeModelAsync(compactSwap.scratch, 1);
+        break;
+      case COMPACT_LOAD_OTHER:
+        if (otherUsed) return fingerprintSensor.loadModelAsync(compactSwap.location, 2);
+        break;
+      case COMPACT_STORE_HOT:
+        if (otherUsed) return fingerprintSensor.storeModelAsync(compactSwap.hotSlot, 2);
+        break;
+      case COMPACT_LOAD_SCRATCH:
+        if (scratchUsed) return fingerprintSensor.loadModelAsync(compactSwap.scratch, 1);
+        break;
+      case COMPACT_STORE_OTHER:
+        if (hotUsed) return fingerprintSensor.storeModelAsync(compactSwap.location, 1);
+        break;
+      case COMPACT_DELETE:
+        // the scratch copy, or the template of the only used location, which is now stored in both
+        if (scratchUsed) return fingerprintSensor.deleteModelAsync(compactSwap.scratch);
+        if (hotUsed && !otherUsed) return fingerprintSensor.deleteModelAsync(compactSwap.hotSlot);
+        if (otherUsed && !hotUsed) return fingerprintSensor.deleteModelAsync(compactSwap.location);
+        break;
+      default:
+        return true;
     }
-    fingeprintLEDOn();
-    validateFinger = false;
+    compactStep = (CompactSteps_t)(compactStep + 1);
   }
-  
 }
 
 /**
- * @brief	 Executes the fingerprint registration loop
+ * @brief	 Records a completed template exchange
  */
-void enrollFingerprintLoop(void)
+void finishCompaction(void)
 {
-  if (enrollFinger)
+  // the index followed the stores and deletes as the sensor acknowledged them
+  hotUsers.commitSwap(&compactSwap);
+
+  #ifdef DEBUG_FINGERPRINT
+    debugSerial.print("Fingerprint hot slot "); debugSerial.print(compactSwap.hotSlot);
+    debugSerial.print(" exchanged with "); debugSerial.println(compactSwap.location);
+  #endif
+
+  compactStep = COMPACT_IDLE;
+}
+
+/**
+ * @brief	 Plans the next hot-tier template exchange, and persists it before anything is stored
+ *          When both locations hold a template, a free location keeps a copy of the hot slot template until
+ *          it is stored at the other location, so each template is always in the library at least once
+ * 
+ * @return true -> An exchange was started
+ * @return false -> No exchange is due, or the library has no free location for the copy
+ */
+bool planCompaction(void)
+{
+  if (!hotUsers.planSwap(&compactSwap)) return false;
+
+  if (fingerprintIndex.isUsed(compactSwap.hotSlot)) compactSwap.flags |= HOT_SWAP_HOT_USED;
+  if (fingerprintIndex.isUsed(compactSwap.location)) compactSwap.flags |= HOT_SWAP_OTHER_USED;
+
+  compactSwap.scratch = HOT_USER_NONE;
+  if ((compactSwap.flags & HOT_SWAP_HOT_USED) && (compactSwap.flags & HOT_SWAP_OTHER_USED))
   {
-    enrollFingerprint();
-    fingeprintLEDOn();
-    enrollFinger = false;
+    compactSwap.scratch = fingerprintIndex.allocate();
+    if (compactSwap.scratch == FINGERPRINT_INDEX_NONE) return false;
   }
+
+  compactSwap.step = COMPACT_LOAD_HOT;
+  hotUsers.saveSwap(&compactSwap);
+
+  compactRetries = 0;
+  compactStep = COMPACT_LOAD_HOT;
+  return true;
 }
 
 /**
- * @brief	Reads the fingerprint on the sensor, and performs verification
- *          Executed within the fingerprint verification loop
- * 
- * @return true -> Verification success. Record found
- * @return false -> Verfication failed. Record not found, or error reading fingerprint
+ * @brief	 Executes the hot-tier compaction loop
+ *          Moves the most frequent users into the hot tier, one sensor command per call, while the sensor is idle.
+ *          Once planned, an exchange is never abandoned: a failed step runs again from the last store the sensor
+ *          acknowledged, and an exchange that keeps failing re-initialises the sensor and resumes once it is back.
+ *          Fingerprint verification waits meanwhile, the map only matches the library once the exchange is done
  */
-bool getFingerprint(void)
+void compactionLoop(void)
 {
-  #ifdef DEBUG_FINGERPRINT
-    Serial.println("Fingerprint image capture");
-  #endif
-  
-  // log image capture started
-  uint8_t p = fingerprintSensor.getImage();
-  // log image capture error
-  if (p != FINGERPRINT_OK)  return false;
-  // log image capture successful
+  if (compactStep == COMPACT_IDLE)
+  {
+    if (!sensorIdle()) return;
+    if (!planCompaction()) return;
+  }
+  else if (compactResume)
+  {
+    // the sensor buffers didn't survive, so the exchange resumes from what the library holds
+    if (!fingerprintReady || (fingerprintSensor.commandState() != FINGERPRINT_CMD_IDLE)) return;
 
-  #ifdef DEBUG_FINGERPRINT
-    Serial.println("Fingerprint image capture success");
-  #endif
+    #ifdef DEBUG_FINGERPRINT
+      debugSerial.print("Fingerprint hot slot exchange resumed at step ");
+      debugSerial.println(compactSwap.step);
+    #endif
 
-  #ifdef DEBUG_FINGERPRINT
-    Serial.println("Fingerprint image conversion");
-  #endif
-  
-  // log image to feature template conversion started
-  p = fingerprintSensor.image2Tz();  
-  //log image to feature template conversion error
-  if (p != FINGERPRINT_OK)  return false;
-  // log image to feature template conversion success
+    compactResume = false;
+    compactRetries = 0;
+    compactStep = (CompactSteps_t)compactSwap.step;
+  }
+  else
+  {
+    uint8_t state = fingerprintSensor.commandState();
+    if (state == FINGERPRINT_CMD_PENDING) return;
 
-  #ifdef DEBUG_FINGERPRINT
-    Serial.println("Fingerprint image conversion success");
-  #endif
+    // an idle engine means the step's command never started, or a blocking call took over the engine;
+    // run again from the last acknowledged store, the buffers may no longer hold the templates
+    if (state == FINGERPRINT_CMD_IDLE)
+    {
+      compactStep = (CompactSteps_t)compactSwap.step;
+      issueCompactStep();
+      return;
+    }
 
-  #ifdef DEBUG_FINGERPRINT
-    Serial.println("Fingerprint search");
-  #endif
+    if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+    {
+      compactErrors++;
+      if (++compactRetries > 3)
+      {
+        // the library is re-read when the sensor is brought up again, the exchange is finished after that
+        #ifdef DEBUG_FINGERPRINT
+          debugSerial.println("Fingerprint hot slot exchange failed");
+        #endif
+        compactResume = true;
+        recoverSensor();
+        return;
+      }
 
-  // log fingerprint search started
-//  return fingerprintSensor.fingerFastSearch();
-  p = fingerprintSensor.fingerSearch();
-  // log fingerprint search error
-  if (p != FINGERPRINT_OK) return false;
-  if (p == FINGERPRINT_NOTFOUND) return false;
-  // log fingerprint search success
+      // a store may have gone through, or the sensor restarted, the buffers are filled again from the library
+      compactStep = (CompactSteps_t)compactSwap.step;
+    }
+    else
+    {
+      bool stored = (compactStep != COMPACT_LOAD_HOT) && (compactStep != COMPACT_LOAD_OTHER) && (compactStep != COMPACT_LOAD_SCRATCH);
 
-  #ifdef DEBUG_FINGERPRINT
-    Serial.println("Fingerprint search match found");
-  #endif
-  
-  return true;
+      compactStep = (CompactSteps_t)(compactStep + 1);
+      if (stored)
+      {
+        // retries count from the last acknowledged store, as failed steps go back to it
+        compactRetries = 0;
+        compactSwap.step = compactStep;
+        hotUsers.saveSwap(&compactSwap);
+      }
+    }
+  }
+
+  if (!issueCompactStep()) return;
+  if (compactStep == COMPACT_DONE) finishCompaction();
 }
 
 /**
@@ -388,9 +1977,9 @@ bool getFingerprint(void)
 void keypadEventCallback(char pressed, KeyEdge_t edge)
 {
   #ifdef DEBUG_KEYPAD
-    Serial.print(pressed);
-    if (edge == FALLING_EDGE) Serial.println(" pressed");
-    if (edge == RISING_EDGE) Serial.println(" released");
+    debugSerial.print(pressed);
+    if (edge == FALLING_EDGE) debugSerial.println(" pressed");
+    if (edge == RISING_EDGE) debugSerial.println(" released");
   #endif
   
   switch (access_keypad.getCurrentKeypadState())
@@ -411,11 +2000,29 @@ void keypadEventCallback(char pressed, KeyEdge_t edge)
           {
             // if within long-press threshold, change to PIN screen
             // Change keypad to PIN state
+            clearUserId();
             memset(pinInputBuffer, '\0', sizeof(pinInputBuffer));
             access_display.resetPinChars();
             access_display.openPassScreen();
             access_keypad.changeKeypadToState(PIN_STATE);
           }
+          else
+          {
+            // short press, part of a user ID
+            addUserIdDigit(pressed);
+          }
+        }
+      }
+      else if (edge == RISING_EDGE)
+      {
+        // Listen for the rising edge for user ID digits, 'A' clears the ID
+        if ((pressed >= '0') && (pressed <= '9'))
+        {
+          addUserIdDigit(pressed);
+        }
+        else if (pressed == 'A')
+        {
+          clearUserId();
         }
       }
       break;
@@ -432,10 +2039,10 @@ void keypadEventCallback(char pressed, KeyEdge_t edge)
           access_display.addPinCharInput();
 
           #ifdef DEBUG_KEYPAD
-            Serial.print("Num chars: ");
-            Serial.print(access_display.getNumCharsInput());
-            Serial.print(", PIN: ");
-            Serial.println(pinInputBuffer);
+            debugSerial.print("Num chars: ");
+            debugSerial.print(access_display.getNumCharsInput());
+            debugSerial.print(", PIN: ");
+            debugSerial.println(pinInputBuffer);
           #endif
 
           // When 4 characters are input, compare against current PIN
@@ -555,8 +2162,8 @@ void keypadEventCallback(char pressed, KeyEdge_t edge)
               access_display.selectItem();
 
               #ifdef DEBUG_DISPLAY
-                Serial.print("Current screen: "); Serial.println(access_display.getCurrentScreen());
-                Serial.print("Current PIN screen: "); Serial.println(access_display.getCurrentPinScreen());
+                debugSerial.print("Current screen: "); debugSerial.println(access_display.getCurrentScreen());
+                debugSerial.print("Current PIN screen: "); debugSerial.println(access_display.getCurrentPinScreen());
               #endif
               
               switch (access_display.getCurrentScreen())
@@ -620,13 +2227,13 @@ void keypadEventCallback(char pressed, KeyEdge_t edge)
 void fingerprintSensorTouchCallback(FingerTouchState_t state)
 {
   #ifdef DEBUG_FINGERPRINT
-    Serial.println("Fingerprint sensor touch callback");
+    debugSerial.println("Fingerprint sensor touch callback");
   #endif
   
   if (state == FINGER_PLACED)
   {
     #ifdef DEBUG_FINGERPRINT
-      Serial.println("Finger placed");
+      debugSerial.println("Finger placed");
     #endif
     
     switch (access_display.getCurrentScreen())
@@ -646,7 +2253,7 @@ void fingerprintSensorTouchCallback(FingerTouchState_t state)
   else if (state == FINGER_REMOVED)
   {
     #ifdef DEBUG_FINGERPRINT
-      Serial.println("Finger removed");
+      debugSerial.println("Finger removed");
     #endif
     
     if (access_display.getEnrollFingerStep() == REMOVE_FINGER_PROMPT)
@@ -659,137 +2266,191 @@ void fingerprintSensorTouchCallback(FingerTouchState_t state)
 
 /**
  * @brief	 Executes the fingerprint registration logic
+ *          Executed within the fingerprint registration loop. Each call advances the registration by at most
+ *          one step and never waits on the sensor; the commands are completed by the fingerprint command loop
+ * 
+ * @return true -> The touch has been handled, the outcome is on the display
+ * @return false -> Registration step in progress, call again
  */
-void enrollFingerprint(void)
+bool enrollFingerprint(void)
 {
-  // Display "place finger text" (enrolling ID = FINGERPRINT_COUNT + 1)
+  // Display "place finger text" (enrolling ID = lowest free index)
   // success or error of fingerprint placement
   // if success, remove finger
   // place the same finger a second time
   // success or error of fingerprint placement, and fingerprint match
   // successfully recorded fingerprint
   
-  switch (access_display.getEnrollFingerStep())
+  switch (enrollStep)
   {
-  case INITIAL_CAPTURE_PROMPT:
-    captureFingerprint();
-    break;
+    case ENROLL_IDLE:
+      // the first touch goes into slot 1, the repeated one into slot 2
+      switch (access_display.getEnrollFingerStep())
+      {
+        case INITIAL_CAPTURE_PROMPT:
+          enrollSlot = 1;
+          break;
+        case REPEAT_CAPTURE_PROMPT:
+          enrollSlot = 2;
+          break;
+        default:
+          return true;
+      }
 
-  case REPEAT_CAPTURE_PROMPT:
-    recaptureFingerprint();
-    break;
-  
-  default:
-    break;
-  }
-}
+      enrollStartMillis = millis();
+      if (!fingerprintSensor.getImageAsync()) return endEnroll(CAPTURE_ERROR);
+      enrollStep = ENROLL_CAPTURE;
+      break;
 
-/**
- * @brief	 Executes the fingerprint capture logic during fingerprint registration
- *          Performs the initial capture
- */
-void captureFingerprint(void)
-{
-  // Wait for the finger to settle on the sensor
-  getFingerprintDebounceMillis = millis();
-  while ((millis() - getFingerprintDebounceMillis) < 500);
-    
-  if (fingerprintSensor.getImage() == FINGERPRINT_OK)
-  {
-    if (fingerprintSensor.image2Tz(1) == FINGERPRINT_OK)
-    {
-      // Fingerprint capture success
-      // Remove finger
-      #ifdef DEBUG_FINGERPRINT
-        Serial.println("Fingerprint capture success");
-      #endif
-      access_display.setEnrollFingerStep(CAPTURE_SUCCESS);
-    }
-    else
-    {
-      // Fingerprint image conversion error
-      #ifdef DEBUG_FINGERPRINT
-        Serial.println("Fingerprint conversion error");
-      #endif
-      access_display.setEnrollFingerStep(CONVERSION_ERROR);
-    }
-    
-  }
-  else
-  {
-    // Fingerprint capture error
-    #ifdef DEBUG_FINGERPRINT
-      Serial.println("Fingerprint capture error");
-    #endif
-    access_display.setEnrollFingerStep(CAPTURE_ERROR);
-  }
-  
-}
+    case ENROLL_CAPTURE:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
 
-/**
- * @brief	 Executes the fingerprint recapture logic during fingerprint registration
- *          Performs the second capture, creates the fingerprint model and saves the fingerprint into memory
- */
-void recaptureFingerprint(void)
-{
-  // Wait for the finger to settle on the sensor
-  getFingerprintDebounceMillis = millis();
-  while ((millis() - getFingerprintDebounceMillis) < 500);
-  
-  if (fingerprintSensor.getImage() == FINGERPRINT_OK)
-  {
-    if (fingerprintSensor.image2Tz(2) == FINGERPRINT_OK)
-    {
-      // Create model
-      if (fingerprintSensor.createModel() == FINGERPRINT_OK)
+      switch (captureOutcome(fingerprintSensor.commandResult(), enrollStartMillis))
       {
-        // save model at index
-        if (fingerprintSensor.storeModel(++FINGERPRINT_COUNT) == FINGERPRINT_OK)
-        {
-          // Save success
+        case CAPTURE_RETRY:
+          if (!fingerprintSensor.getImageAsync()) return endEnroll(CAPTURE_ERROR);
+          return false;
+        case CAPTURE_FAILED:
+          // Fingerprint capture error
           #ifdef DEBUG_FINGERPRINT
-            Serial.println("Fingerprint save success");
+            debugSerial.println("Fingerprint capture error");
           #endif
-          access_display.setEnrollFingerStep(SAVE_SUCCESS);
-        }
-        else
-        {
-          // Save error
+          return endEnroll(CAPTURE_ERROR);
+        default:
+          break;
+      }
+
+      if (!fingerprintSensor.image2TzAsync(enrollSlot)) return endEnroll(CONVERSION_ERROR);
+      enrollStep = ENROLL_CONVERT;
+      break;
+
+    case ENROLL_CONVERT:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+      {
+        // Fingerprint image conversion error
+        #ifdef DEBUG_FINGERPRINT
+          debugSerial.println("Fingerprint conversion error");
+        #endif
+        return endEnroll(CONVERSION_ERROR);
+      }
+
+      if (enrollSlot == 1)
+      {
+        // Fingerprint capture success
+        // Remove finger
+        #ifdef DEBUG_FINGERPRINT
+          debugSerial.println("Fingerprint capture success");
+        #endif
+        return endEnroll(CAPTURE_SUCCESS);
+      }
+
+      // Create model
+      if (!fingerprintSensor.createModelAsync()) return endEnroll(MATCH_ERROR);
+      enrollStep = ENROLL_MODEL;
+      break;
+
+    case ENROLL_MODEL:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
+      {
+        // Fingerprints did not match
+        #ifdef DEBUG_FINGERPRINT
+          debugSerial.println("Fingerprint match error");
+        #endif
+        return endEnroll(MATCH_ERROR);
+      }
+
+      if (fingerprintIndex.count() == 0) return storeEnrollment();
+
+      // look the new model (in slot 1) up in the library before saving it,
+      // so the same finger isn't registered twice
+      if (!fingerprintSensor.fingerSearchAsync(1, fingerprintIndex.searchStart(), fingerprintIndex.searchCount())) return endEnroll(SAVE_ERROR);
+      enrollStep = ENROLL_DUPLICATE;
+      break;
+
+    case ENROLL_DUPLICATE:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      switch (fingerprintSensor.commandResult())
+      {
+        case FINGERPRINT_OK:
+          // Already registered
           #ifdef DEBUG_FINGERPRINT
-            Serial.println("Fingerprint save error");
+            debugSerial.print("Fingerprint already registered, user ID: ");
+            debugSerial.println(hotUsers.toUserId(fingerprintSensor.fingerID));
           #endif
-          access_display.setEnrollFingerStep(SAVE_ERROR);
-        }
-        
+          return endEnroll(DUPLICATE_ERROR);
+        case FINGERPRINT_NOTFOUND:
+          return storeEnrollment();
+        default:
+          break;
       }
-      else
+      // Save error
+      #ifdef DEBUG_FINGERPRINT
+        debugSerial.println("Fingerprint save error");
+      #endif
+      return endEnroll(SAVE_ERROR);
+
+    case ENROLL_STORE:
+      if (fingerprintSensor.commandState() != FINGERPRINT_CMD_DONE) break;
+      if (fingerprintSensor.commandResult() != FINGERPRINT_OK)
       {
-        // Fingerprints did not match
+        // Save error
         #ifdef DEBUG_FINGERPRINT
-          Serial.println("Fingerprint match error");
+          debugSerial.println("Fingerprint save error");
         #endif
-        access_display.setEnrollFingerStep(MATCH_ERROR);
+        return endEnroll(SAVE_ERROR);
       }
-    }
-    else
-    {
-      // Fingerprint image conversion error
+
+      templateCache.touch(enrollId);
+      // Save success
       #ifdef DEBUG_FINGERPRINT
-        Serial.println("Fingerprint conversion error");
+        debugSerial.print("Fingerprint save success, user ID: ");
+        debugSerial.println(hotUsers.toUserId(enrollId));
       #endif
-      access_display.setEnrollFingerStep(CONVERSION_ERROR);
-    }
-    
+      return endEnroll(SAVE_SUCCESS);
+
+    default:
+      break;
   }
-  else
+
+  return false;
+}
+
+/**
+ * @brief	 Starts storing the new model (in slot 1) at the lowest free library location
+ * 
+ * @return false -> Store started
+ * @return true -> No free location, or the store couldn't be started
+ */
+bool storeEnrollment(void)
+{
+  // save model at the lowest free index
+  enrollId = fingerprintIndex.allocate();
+  if ((enrollId == FINGERPRINT_INDEX_NONE) || !fingerprintSensor.storeModelAsync(enrollId))
   {
-    // Fingerprint capture error
+    // Save error
     #ifdef DEBUG_FINGERPRINT
-      Serial.println("Fingerprint capture error");
+      debugSerial.println("Fingerprint save error");
     #endif
-    access_display.setEnrollFingerStep(CAPTURE_ERROR);
+    return endEnroll(SAVE_ERROR);
   }
-  
+
+  enrollStep = ENROLL_STORE;
+  return false;
+}
+
+/**
+ * @brief	 Ends the registration step of this touch, showing its outcome
+ * 
+ * @param outcome -> the registration step to show
+ * @return true
+ */
+bool endEnroll(AddFingerSteps_t outcome)
+{
+  enrollStep = ENROLL_IDLE;
+  access_display.setEnrollFingerStep(outcome);
+  return true;
 }
 
 /**
@@ -803,14 +2464,14 @@ void contactSensorCallback(ContactEvent_t event)
     if (event == DOOR_CLOSED)
     {
       #ifdef DEBUG_CONTACT
-        Serial.println("Door closed!");
+        debugSerial.println("Door closed!");
       #endif
       access_lock.closeLock();
     }
     else if (event == DOOR_OPEN)
     {
       #ifdef DEBUG_CONTACT
-        Serial.println("Door open!");
+        debugSerial.println("Door open!");
       #endif
     }
 }
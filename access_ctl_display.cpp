@@ -216,6 +216,14 @@ void AccessCtlDisplay::drawAddFingerScreen(void)
 			setEnrollFingerStep(INITIAL_CAPTURE_PROMPT);
 		}
 		break;
+	case DUPLICATE_ERROR:
+		display_text[0] = "Already";
+		display_text[1] = "registered!";
+		if ((get_timing_millis() - info_screen_timing) > 1000)
+		{
+			setEnrollFingerStep(INITIAL_CAPTURE_PROMPT);
+		}
+		break;
 
 	default:
 		break;
@@ -414,6 +422,12 @@ void AccessCtlDisplay::drawStatusScreen(void)
 	switch (currentScreen)
 	{
 	case DEFAULT_SCREEN:
+		if (userIdInput && userIdInput[0])
+		{
+			display_text[0] = "User ID:";
+			display_text[1] = (char *)userIdInput;
+			break;
+		}
 		display_text[0] = "Place finger";
 		display_text[1] = "on scanner";
 		break;
@@ -777,6 +791,7 @@ void AccessCtlDisplay::setEnrollFingerStep(AddFingerSteps_t step)
 	case MATCH_ERROR:
 	case SAVE_SUCCESS:
 	case SAVE_ERROR:
+	case DUPLICATE_ERROR:
 		info_screen_timing = get_timing_millis();
 		break;
 
@@ -784,3 +799,15 @@ void AccessCtlDisplay::setEnrollFingerStep(AddFingerSteps_t step)
 		break;
 	}
 }
+
+/**
+ * @brief	Sets the buffer holding the user ID keyed-in on the default screen
+ *          The default screen shows the ID instead of the scan prompt while the buffer isn't empty
+ *
+ * @param input
+ * @return none
+ */
+void AccessCtlDisplay::setUserIdInput(const char *input)
+{
+	userIdInput = input;
+}
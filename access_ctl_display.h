@@ -113,7 +113,8 @@ typedef enum ADD_FINGER_STEPS : uint8_t
     MATCH_SUCCESS,
     MATCH_ERROR,
     SAVE_SUCCESS,
-    SAVE_ERROR
+    SAVE_ERROR,
+    DUPLICATE_ERROR
 } AddFingerSteps_t;
 
 /**
@@ -130,6 +131,7 @@ private:
     PinChars_t numPinCharsInput = ZERO_CHARS;           /*< Keeps track of the number of pin characters already input */
     PinScreens_t currentPinScreen = PIN_SCREEN;         /*< Keeps track of the current screen for pin configuration */
     AddFingerSteps_t addFingerCurrentStep = STEPS_NONE; /*< Keeps track of the current step in the fingerprint registration process */
+    const char *userIdInput = NULL;                     /*< User ID being keyed-in for a 1:1 fingerprint check, shown on the default screen */
 
     /**
      * @brief   Clears the display
@@ -342,6 +344,15 @@ public:
      * @return none
      */
     void setEnrollFingerStep(AddFingerSteps_t step);
+
+    /**
+     * @brief	Sets the buffer holding the user ID keyed-in on the default screen
+     *          The default screen shows the ID instead of the scan prompt while the buffer isn't empty
+     * 
+     * @param input 
+     * @return none
+     */
+    void setUserIdInput(const char *input);
 };
 
 #endif
@@ -87,6 +87,7 @@ void keypad_setup(void)
 /**
  * @brief	 Function to initialize Timer1 with no prescaler
  *        Timer1 is used to set precise delays in clock ticks for reading the keypad
+ *        It is left running free, it is shared with the fingerprint serial TX
  * 
  * @param none
  * @return none
@@ -127,6 +128,9 @@ void attach_event_callback(void (*callback)(char, KeyEdge_t))
 
 /**
  * @brief	ISR for detecting and responding to keypad events.
+ *        The column scan busy-waits about 5us per column, longer in all than a bit time of the
+ *        fingerprint serial TX (8.7us at 115200 baud), whose Timer1 interrupt has to set up every bit.
+ *        The scan and the callback therefore run with interrupts enabled, and only this interrupt masked
  */
 ISR(PCINT1_vect)
 {
@@ -134,6 +138,11 @@ ISR(PCINT1_vect)
   if ((get_timing_millis() - lastKeyPressMillis) >= 50)
   {
     lastKeyPressMillis = get_timing_millis();
+
+    // the scan toggles the columns, the pin changes it causes are taken once it's unmasked again,
+    // and dropped by the debounce above
+    PCICR &= ~(1 << PCIE1);
+    sei();
         
     previousKeyState = keyState;
     // shift readings of PC0 - PC4 into the upper 4 bits of the 8-bit value
@@ -162,7 +171,8 @@ ISR(PCINT1_vect)
         for (int col = 0; col < NUM_COLS; col++)
         {
           timerCnt = 0;
-          TCNT1 = 0;
+          // Timer1 runs free (the fingerprint serial TX clocks its bits off it), so count from its current value
+          uint16_t delayStart = TCNT1;
           // set a single column low at a time *verified*
           PORTD &= ~(1 << (col+4));
     
@@ -170,7 +180,7 @@ ISR(PCINT1_vect)
           // For some reason it takes different times for the change to take effect
           // Imperically: 24clks for row 1, 34 clks for row 2, 44 clks for row 3, 54 clks for row 4
           // And some sporadic bursts of up to 65clks (as per observations
-          while (TCNT1 < 80); // delay for 5us
+          while ((uint16_t)(TCNT1 - delayStart) < 80); // delay for 5us
           
           /**
            * If the row has changed state, then we've found the culprit column!
@@ -199,6 +209,9 @@ ISR(PCINT1_vect)
       // Execute the keypad-event detected routine
       keypad_event_listener();
     }
+
+    cli();
+    PCICR |= (1 << PCIE1);
   }
 
 }